@@ -7,6 +7,7 @@
 #include "OB6.h"
 
 #include "OB6Patch.h"
+#include "OB6Hash.h"
 
 #include "MidiHelpers.h"
 #include "MidiController.h"
@@ -15,6 +16,8 @@
 
 #include <boost/format.hpp>
 
+#include <algorithm>
+
 namespace midikraft {
 
 	// The values are  indexes into the global parameter dump
@@ -40,6 +43,29 @@ namespace midikraft {
 		ARP_BEAT_SYNC = 18 // Sadly this is not stored in the byte 18 of the sysex data package
 	};
 
+	// Typed access to the sysex data of a global parameter dump (0x0f), reading straight from the message without copying it
+	class OB6GlobalDumpView {
+	public:
+		OB6GlobalDumpView(const uint8 *sysexData, size_t sysexSize) : data_(sysexData), size_(sysexSize) {}
+
+		bool isValid() const { return size_ > 2 && data_[2] == 0x0f /* main parameter data */; }
+		bool contains(int param) const { return param + kHeaderSize < size_; }
+		int operator[](int param) const { return data_[param + kHeaderSize]; }
+
+		bool localControl() const { return contains(LOCAL_CONTROL) && (*this)[LOCAL_CONTROL] == 1; }
+		bool midiControl() const { return contains(MIDI_CONTROL) && (*this)[MIDI_CONTROL] == 1; }
+		MidiChannel midiChannel() const {
+			if (!contains(MIDI_CHANNEL)) return MidiChannel::invalidChannel();
+			int channel = (*this)[MIDI_CHANNEL];
+			return channel == 0 ? MidiChannel::omniChannel() : MidiChannel::fromOneBase(channel);
+		}
+
+	private:
+		static const size_t kHeaderSize = 3; // DSI ID, model ID, opcode
+		const uint8 *data_;
+		size_t size_;
+	};
+
 	// Warnings for the user
 	// 
 	// The panel will only work when the parameter "MIDI Param Rcv" is set to NRPN. And if you switch it away, it will stop working.
@@ -68,6 +94,24 @@ namespace midikraft {
 	// ARP_BEAT_SYNC 1036 is not documented. Doesn't help, because you can only switch it off, due to the bug above you can't switch it on
 	// Manual states wrongly on page 77 that MIDI Param Receive is ignored when received, but that is not entirely true 
 
+	// The highest raw value that can be set via NRPN, for all settings affected by the bugs listed above
+	std::map<int, int> kOB6HighestValueSettableViaNRPN() {
+		return {
+			{ MIDI_CLOCK, 3 },
+			{ PARAM_TRANSMIT, 3 },
+			{ MIDI_OUT, 2 },
+			{ LOCAL_CONTROL, 0 },
+			{ VELOCITY_RESPONSE, 6 },
+			{ AFTERTOUCH_RESPONSE, 2 },
+			{ STEREO_MONO, 0 },
+			{ POT_MODE, 1 },
+			{ SEQ_JACK, 2 },
+			{ ALT_TUNING, (int) kDSIAlternateTunings().size() - 2 },
+			{ SUSTAIN_POLARITY, 2 },
+			{ ARP_BEAT_SYNC, 0 },
+		};
+	}
+
 	struct gOB6GlobalSettings {
 		std::vector<DSIGlobalSettingDefinition> definitions = {
 			{ TRANSPOSE, 1025, { "Transpose", "Tuning", 12, -12, 12 },  -12 }, // Default 12, displayed as 0
@@ -110,7 +154,7 @@ namespace midikraft {
 	};
 
 	std::vector<Range<int>> kOB6BlankOutZones = {
-		{ 107, 127 }, // 20 Characters for the name
+		{ kOB6ProgramNameStart, kOB6ProgramNameEnd }, // 20 Characters for the name
 	};
 
 
@@ -146,20 +190,18 @@ namespace midikraft {
 
 	std::shared_ptr<DataFile> OB6::patchFromSysex(const MidiMessage& message) const
 	{
-		if (isOwnSysex(message)) {
-			if (message.getSysExDataSize() > 2) {
-				uint8 messageCode = message.getSysExData()[2];
-				if (messageCode == 0x02 /* program data dump */ || messageCode == 0x03 /* edit buffer dump */) {
-					int startIndex = messageCode == 0x02 ? 5 : 3;
-					const uint8 *startOfData = &message.getSysExData()[startIndex];
-					auto globalDumpData = unescapeSysex(startOfData, message.getSysExDataSize() - startIndex, 1024);
-					MidiProgramNumber place;
-					if (messageCode == 0x02) {
-						place = MidiProgramNumber::fromZeroBase(message.getSysExData()[3] * 100 + message.getSysExData()[4]);
-					}
-					auto patch = std::make_shared<OB6Patch>(OB6::PATCH, globalDumpData, place);
-					return patch;
+		auto kind = classifyMessage(message);
+		if (kind == MessageKind::PROGRAM_DUMP || kind == MessageKind::EDIT_BUFFER_DUMP) {
+			int startIndex = kind == MessageKind::PROGRAM_DUMP ? 5 : 3;
+			if (message.getSysExDataSize() > startIndex) {
+				const uint8 *startOfData = &message.getSysExData()[startIndex];
+				auto globalDumpData = unescapeSysex(startOfData, message.getSysExDataSize() - startIndex, 1024);
+				MidiProgramNumber place;
+				if (kind == MessageKind::PROGRAM_DUMP) {
+					place = MidiProgramNumber::fromZeroBase(message.getSysExData()[3] * 100 + message.getSysExData()[4]);
 				}
+				auto patch = std::make_shared<OB6Patch>(OB6::PATCH, globalDumpData, place);
+				return patch;
 			}
 		}
 		return std::shared_ptr<Patch>();
@@ -181,6 +223,8 @@ namespace midikraft {
 		std::vector<uint8> message({ 0x01 /* DSI */, midiModelID_, 0x03 /* Edit Buffer data */ });
 		auto escaped = escapeSysex(patch->data(), patch->data().size());
 		std::copy(escaped.begin(), escaped.end(), std::back_inserter(message));
+		// We don't know whether the caller sends this dump, so the shadow can't be trusted anymore. patchToSysexIfChanged sets it again
+		editBufferFingerprint_ = 0;
 		return std::vector<juce::MidiMessage>({ MidiHelpers::sysexMessage(message) });
 	}
 
@@ -193,20 +237,20 @@ namespace midikraft {
 	MidiChannel OB6::channelIfValidDeviceResponse(const MidiMessage &message)
 	{
 		if (isGlobalSettingsDump(message)) {
-			localControl_ = message.getSysExData()[3 + LOCAL_CONTROL] == 1;
-			midiControl_ = message.getSysExData()[3 + MIDI_CONTROL] == 1;
-			int midiChannel = message.getSysExData()[MIDI_CHANNEL + 3];
-			if (midiChannel == 0) {
-				return MidiChannel::omniChannel();
-
-			}
-			// Can you use this to init the global settings!
-			auto dataFile = loadData({ message }, DataStreamType(GLOBAL_SETTINGS));
-			if (dataFile.size() > 0) {
-				setGlobalSettingsFromDataFile(dataFile[0]);
-			}
+			OB6GlobalDumpView dump(message.getSysExData(), message.getSysExDataSize());
+			localControl_ = dump.localControl();
+			midiControl_ = dump.midiControl();
+			// Use this to init the global settings, decoded directly from the message. This also works when the synth is in Omni mode
+			updateGlobalSettingsFromDump(message.getSysExData(), message.getSysExDataSize());
+			return dump.midiChannel();
+		}
+		return MidiChannel::invalidChannel();
+	}
 
-			return  MidiChannel::fromOneBase(midiChannel);
+	MidiChannel OB6::channelFromGlobalSettingsDump(const MidiMessage &message) const
+	{
+		if (isGlobalSettingsDump(message)) {
+			return OB6GlobalDumpView(message.getSysExData(), message.getSysExDataSize()).midiChannel();
 		}
 		return MidiChannel::invalidChannel();
 	}
@@ -268,22 +312,32 @@ namespace midikraft {
 		return {};
 	}
 
-	bool OB6::isDataFile(const MidiMessage &message, DataFileType dataTypeID) const
+	OB6::MessageKind OB6::classifyMessage(MidiMessage const &message) const
 	{
-		if (isOwnSysex(message)) {
-			switch (dataTypeID.asInt())
-			{
-			case PATCH:
-				return isSingleProgramDump(message) || isEditBufferDump(message);
-			case GLOBAL_SETTINGS:
-				return isGlobalSettingsDump(message);
-			case ALTERNATE_TUNING:
-				return MidiTuning::isTuningDump(message);
-			default:
-				jassert(false);
+		// Look at each header byte only once - this is called for every message arriving while a librarian operation is running
+		if (!message.isSysEx()) {
+			return MessageKind::FOREIGN;
+		}
+		int size = message.getSysExDataSize();
+		const uint8 *data = message.getSysExData();
+		if (size > 2 && data[0] == 0x01 /* DSI */ && data[1] == midiModelID_) {
+			switch (data[2]) {
+			case 0x02: return size > 4 ? MessageKind::PROGRAM_DUMP : MessageKind::FOREIGN;
+			case 0x03: return MessageKind::EDIT_BUFFER_DUMP;
+			case 0x0f: return MessageKind::GLOBAL_DUMP;
+			default: return MessageKind::FOREIGN;
 			}
 		}
-		return false;
+		if (size > 3 && data[0] == 0x7e /* Universal non-realtime */ && data[2] == 0x08 /* MIDI Tuning Standard */) {
+			// Only now it is worth to have the full look
+			return MidiTuning::isTuningDump(message) ? MessageKind::TUNING_DUMP : MessageKind::FOREIGN;
+		}
+		return MessageKind::FOREIGN;
+	}
+
+	bool OB6::isDataFile(const MidiMessage &message, DataFileType dataTypeID) const
+	{
+		return isKindOfDataType(classifyMessage(message), dataTypeID.asInt());
 	}
 
 	bool OB6::isPartOfDataFileStream(const MidiMessage &message, DataStreamType dataTypeID) const
@@ -294,36 +348,61 @@ namespace midikraft {
 	std::vector<std::shared_ptr<midikraft::DataFile>> OB6::loadData(std::vector<MidiMessage> messages, DataStreamType dataTypeID) const
 	{
 		std::vector<std::shared_ptr<DataFile>> result;
-		for (auto m : messages) {
-			if (isPartOfDataFileStream(m, dataTypeID)) {
-				switch (dataTypeID.asInt()) {
-				case GLOBAL_SETTINGS: {
-					std::vector<uint8> syx(m.getSysExData(), m.getSysExData() + m.getSysExDataSize());
-					auto storage = std::make_shared<GlobalSettingsFile>(GLOBAL_SETTINGS, syx);
-					result.push_back(storage);
-					break;
+		for (auto const &m : messages) {
+			auto kind = classifyMessage(m);
+			if (!isKindOfDataType(kind, dataTypeID.asInt())) {
+				continue;
+			}
+			switch (kind) {
+			case MessageKind::PROGRAM_DUMP:
+			case MessageKind::EDIT_BUFFER_DUMP: {
+				auto patch = patchFromSysex(m);
+				if (patch) {
+					result.push_back(patch);
 				}
-				case ALTERNATE_TUNING: {
-					MidiTuning tuning(MidiProgramNumber::fromZeroBase(0), "unused", {});
-					if (MidiTuning::fromMidiMessage(m, tuning)) {
-						std::vector<uint8> mtsData({ m.getSysExData(), m.getSysExData() + m.getSysExDataSize() });
-						auto storage = std::make_shared<MTSFile>(ALTERNATE_TUNING, mtsData);
-						result.push_back(storage);
-					}
-					else {
-						jassert(false);
-					}
-					break;
+				break;
+			}
+			case MessageKind::GLOBAL_DUMP: {
+				std::vector<uint8> syx(m.getSysExData(), m.getSysExData() + m.getSysExDataSize());
+				auto storage = std::make_shared<GlobalSettingsFile>(GLOBAL_SETTINGS, syx);
+				result.push_back(storage);
+				break;
+			}
+			case MessageKind::TUNING_DUMP: {
+				MidiTuning tuning(MidiProgramNumber::fromZeroBase(0), "unused", {});
+				if (MidiTuning::fromMidiMessage(m, tuning)) {
+					std::vector<uint8> mtsData({ m.getSysExData(), m.getSysExData() + m.getSysExDataSize() });
+					auto storage = std::make_shared<MTSFile>(ALTERNATE_TUNING, mtsData);
+					result.push_back(storage);
 				}
-				default:
+				else {
 					jassert(false);
-					// Not implemented yet
 				}
+				break;
+			}
+			default:
+				jassert(false);
 			}
 		}
 		return result;
 	}
 
+	bool OB6::isKindOfDataType(MessageKind kind, int dataTypeID)
+	{
+		switch (dataTypeID)
+		{
+		case PATCH:
+			return kind == MessageKind::PROGRAM_DUMP || kind == MessageKind::EDIT_BUFFER_DUMP;
+		case GLOBAL_SETTINGS:
+			return kind == MessageKind::GLOBAL_DUMP;
+		case ALTERNATE_TUNING:
+			return kind == MessageKind::TUNING_DUMP;
+		default:
+			jassert(false);
+		}
+		return false;
+	}
+
 	std::vector<midikraft::DataFileLoadCapability::DataFileDescription> OB6::dataTypeNames() const
 	{
 		return { { DataFileType(PATCH), "Patch"}, { DataFileType(GLOBAL_SETTINGS), "Global Settings"}, { DataFileType(ALTERNATE_TUNING), "Alternate Tuning"} };
@@ -343,7 +422,7 @@ namespace midikraft {
 	}
 
 	bool OB6::isGlobalSettingsDump(MidiMessage const &message) const {
-		return isOwnSysex(message) && message.getSysExDataSize() > 2 && message.getSysExData()[2] == 0x0f /* main parameter data */;
+		return classifyMessage(message) == MessageKind::GLOBAL_DUMP;
 	}
 
 	void OB6::initGlobalSettings()
@@ -356,7 +435,238 @@ namespace midikraft {
 		}
 		globalSettingsTree_ = ValueTree("OB6SETTINGS");
 		globalSettings_.addToValueTree(globalSettingsTree_);
-		globalSettingsTree_.addListener(&updateSynthWithGlobalSettingsListener_);
+		globalSettingsTree_.addListener(&globalSettingsEchoFilter_);
+	}
+
+	std::vector<std::shared_ptr<TypedNamedValue>> OB6::pushGlobalSettings(MidiController *controller, std::shared_ptr<DataFile> targetSettings)
+	{
+		return pushGlobalSettings(targetSettings, [this, controller](std::vector<MidiMessage> const &messages) {
+			controller->getMidiOutput(midiOutput())->sendBlockOfMessagesFullSpeed(messages);
+		});
+	}
+
+	std::vector<std::shared_ptr<TypedNamedValue>> OB6::pushGlobalSettings(std::shared_ptr<DataFile> targetSettings, std::function<void(std::vector<MidiMessage> const &)> sendMessages)
+	{
+		std::vector<std::shared_ptr<TypedNamedValue>> notApplied;
+		OB6GlobalDumpView target(targetSettings->data().data(), targetSettings->data().size());
+		if (!target.isValid()) {
+			jassertfalse;
+			return notApplied;
+		}
+
+		auto limits = kOB6HighestValueSettableViaNRPN();
+		// The settings that change how (or whether) the synth listens to us go out after all others. Those that keep NRPN reception
+		// working come first, then those that stop it, and the channel change is last because everything before it is built on the old channel
+		struct Change {
+			size_t index;
+			int value;
+			int order;
+		};
+		std::vector<Change> changes;
+		auto const &definitions = kOB6GlobalSettings();
+		for (size_t i = 0; i < definitions.size(); i++) {
+			auto const &definition = definitions[i];
+			if (definition.sysexIndex == ARP_BEAT_SYNC || !target.contains(definition.sysexIndex)) {
+				// Arp Beat Sync is not contained in the dump, so there is nothing to compare against
+				continue;
+			}
+			int targetValue = target[definition.sysexIndex];
+			int currentValue = (int) globalSettings_[i]->value().getValue() - definition.displayOffset;
+			if (targetValue == currentValue) {
+				continue;
+			}
+			auto limit = limits.find(definition.sysexIndex);
+			if (limit != limits.end() && targetValue > limit->second) {
+				notApplied.push_back(globalSettings_[i]);
+				continue;
+			}
+			int order = 0;
+			if (definition.sysexIndex == MIDI_CONTROL) {
+				order = targetValue == 1 ? 1 : 2;
+			}
+			else if (definition.sysexIndex == PARAM_RECEIVE) {
+				order = targetValue == 2 /* NRPN */ ? 1 : 2;
+			}
+			else if (definition.sysexIndex == MIDI_CHANNEL) {
+				order = 3;
+			}
+			changes.push_back({ i, targetValue, order });
+		}
+		std::stable_sort(changes.begin(), changes.end(), [](Change const &a, Change const &b) { return a.order < b.order; });
+
+		std::vector<MidiMessage> nrpns;
+		std::vector<Change> applied;
+		bool receptionStopped = false;
+		for (auto const &change : changes) {
+			if (receptionStopped) {
+				// The synth no longer listens to NRPNs, so this one would be ignored
+				notApplied.push_back(globalSettings_[change.index]);
+				continue;
+			}
+			auto nrpn = createNRPN(definitions[change.index].nrpn, change.value);
+			std::copy(nrpn.begin(), nrpn.end(), std::back_inserter(nrpns));
+			applied.push_back(change);
+			receptionStopped = change.order == 2;
+		}
+		if (!nrpns.empty()) {
+			sendMessages(nrpns);
+		}
+
+		// Bring our own copy up to date as a batch, else the listener would send every NRPN a second time
+		GlobalSettingsBatch batch(*this);
+		for (auto const &change : applied) {
+			auto const &definition = definitions[change.index];
+			batch.set(change.index, change.value + definition.displayOffset);
+			switch (definition.sysexIndex) {
+			case MIDI_CHANNEL:
+				if (change.value != 0) {
+					setCurrentChannelZeroBased(midiInput(), midiOutput(), change.value - 1);
+				}
+				break;
+			case MIDI_CONTROL:
+				midiControl_ = change.value == 1;
+				break;
+			case LOCAL_CONTROL:
+				localControl_ = change.value == 1;
+				break;
+			default:
+				break;
+			}
+		}
+		return notApplied;
+	}
+
+	std::vector<MidiMessage> OB6::createProgramParameterNRPN(int parameterNo, int value)
+	{
+		return createNRPN(parameterNo, value);
+	}
+
+	uint64 OB6::voiceFingerprint(std::shared_ptr<DataFile> patch) const
+	{
+		auto data = filterVoiceRelevantData(patch);
+		uint64 hash = ob6Hash(data.data(), data.size());
+		// Keep 0 free to mark an unknown edit buffer
+		return hash == 0 ? 1 : hash;
+	}
+
+	bool OB6::isInEditBuffer(std::shared_ptr<DataFile> patch) const
+	{
+		return patch && editBufferFingerprint_ == voiceFingerprint(patch);
+	}
+
+	std::vector<MidiMessage> OB6::patchToSysexIfChanged(std::shared_ptr<DataFile> patch)
+	{
+		if (isInEditBuffer(patch)) {
+			return {};
+		}
+		auto result = patchToSysex(patch);
+		setEditBufferShadow(patch);
+		return result;
+	}
+
+	void OB6::setEditBufferShadow(std::shared_ptr<DataFile> patch)
+	{
+		editBufferFingerprint_ = voiceFingerprint(patch);
+	}
+
+	void OB6::invalidateEditBufferShadow()
+	{
+		editBufferFingerprint_ = 0;
+	}
+
+	void OB6::handleIncomingMessage(MidiMessage const &message)
+	{
+		if (classifyMessage(message) == MessageKind::EDIT_BUFFER_DUMP) {
+			auto patch = patchFromSysex(message);
+			if (patch) {
+				setEditBufferShadow(patch);
+			}
+		}
+		else if (message.isProgramChange()) {
+			invalidateEditBufferShadow();
+		}
+		else if (message.isController() && message.getChannel() == channel().toOneBasedInt()) {
+			switch (message.getControllerNumber()) {
+			case 99: case 98: case 6: case 38:
+				// Somebody is turning knobs on the synth, and we don't know what the parameters do to the program
+				invalidateEditBufferShadow();
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	int OB6::updateGlobalSettingsFromDump(const uint8 *sysexData, size_t sysexSize)
+	{
+		OB6GlobalDumpView dump(sysexData, sysexSize);
+		if (!dump.isValid()) {
+			return 0;
+		}
+		// One pass over the dump, touching only those values that really changed so no listener gets called for nothing
+		GlobalSettingsBatch batch(*this);
+		int changed = 0;
+		auto const &definitions = kOB6GlobalSettings();
+		for (size_t i = 0; i < definitions.size(); i++) {
+			auto const &definition = definitions[i];
+			if (definition.sysexIndex == ARP_BEAT_SYNC || !dump.contains(definition.sysexIndex)) {
+				// Byte 18 of the dump is not the Arp Beat Sync value, so leave the setting alone
+				continue;
+			}
+			int value = dump[definition.sysexIndex] + definition.displayOffset;
+			if ((int) globalSettings_[i]->value().getValue() != value) {
+				batch.set(i, value);
+				changed++;
+			}
+		}
+		return changed;
+	}
+
+	void OB6::setGlobalSettingsFromDataFile(std::shared_ptr<DataFile> dataFile)
+	{
+		updateGlobalSettingsFromDump(dataFile->data().data(), dataFile->data().size());
+	}
+
+	ChangeBroadcaster & OB6::globalSettingsChanges()
+	{
+		return globalSettingsChanged_;
+	}
+
+	// The synth whose GlobalSettingsBatch is setting a value on this thread right now. The tree listeners are called synchronously from within setValue(),
+	// so this marks exactly the one property being set, and a UI edit on the message thread at the same time is not affected
+	static thread_local OB6 const *sOB6ApplyingFromSynth = nullptr;
+
+	OB6::GlobalSettingsBatch::GlobalSettingsBatch(OB6 &synth) : synth_(synth)
+	{
+	}
+
+	OB6::GlobalSettingsBatch::~GlobalSettingsBatch()
+	{
+		if (changed_) {
+			// The broadcaster coalesces, so its listeners get one asynchronous callback for the whole batch
+			synth_.globalSettingsChanged_.sendChangeMessage();
+		}
+	}
+
+	void OB6::GlobalSettingsBatch::set(size_t index, int value)
+	{
+		sOB6ApplyingFromSynth = &synth_;
+		synth_.globalSettings_[index]->value().setValue(var(value));
+		sOB6ApplyingFromSynth = nullptr;
+		changed_ = true;
+	}
+
+	OB6::GlobalSettingsEchoFilter::GlobalSettingsEchoFilter(OB6 &synth) : synth_(synth)
+	{
+	}
+
+	void OB6::GlobalSettingsEchoFilter::valueTreePropertyChanged(ValueTree &treeWhosePropertyHasChanged, const Identifier &property)
+	{
+		if (sOB6ApplyingFromSynth == &synth_) {
+			// The synth already has this value
+			return;
+		}
+		static_cast<ValueTree::Listener &>(synth_.updateSynthWithGlobalSettingsListener_).valueTreePropertyChanged(treeWhosePropertyHasChanged, property);
 	}
 
 	std::shared_ptr<midikraft::DataFileLoadCapability> OB6::loader()
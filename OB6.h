@@ -9,8 +9,13 @@
 #include "DSI.h"
 #include "GlobalSettingsCapability.h"
 
+#include <atomic>
+
 namespace midikraft {
 
+	// The bytes of the program data that are not relevant for the sound, i.e. the name
+	extern std::vector<Range<int>> kOB6BlankOutZones;
+
 	class OB6 : public DSISynth, public SingleMessageDataFileLoadCapability, public std::enable_shared_from_this<OB6>
 	{
 	public:
@@ -20,6 +25,14 @@ namespace midikraft {
 			ALTERNATE_TUNING = 2
 		};
 
+		enum class MessageKind {
+			PROGRAM_DUMP,
+			EDIT_BUFFER_DUMP,
+			GLOBAL_DUMP,
+			TUNING_DUMP,
+			FOREIGN
+		};
+
 		OB6();
 
 		virtual std::string getName() const override;
@@ -41,6 +54,8 @@ namespace midikraft {
 		// It should not be necessary to override these two, but somehow I don't see the Sysex output for the device inquiry by the OB-6
 		virtual std::vector<juce::MidiMessage> deviceDetect(int channel) override;
 		virtual MidiChannel channelIfValidDeviceResponse(const MidiMessage &message) override;
+		// Same check, but without taking over any state from the reply. Returns an invalid channel if this is no global settings dump
+		MidiChannel channelFromGlobalSettingsDump(const MidiMessage &message) const;
 
 		// SoundExpanderCapability
 		virtual void changeInputChannel(MidiController *controller, MidiChannel channel, std::function<void()> onFinished) override;
@@ -62,6 +77,9 @@ namespace midikraft {
 		virtual std::vector<DataFileDescription> dataTypeNames() const override;
 		virtual std::vector<DataFileImportDescription> dataFileImportChoices() const override;
 
+		// Single pass classification of an incoming message by manufacturer, model and opcode
+		MessageKind classifyMessage(MidiMessage const &message) const;
+
 		//TODO - these should become part of the DSISynth class
 		virtual std::shared_ptr<DataFileLoadCapability> loader() override;
 		virtual int settingsDataFileType() const override;
@@ -69,13 +87,69 @@ namespace midikraft {
 
 		// Enable the DSISynth implementation of the GlobalSettingsCapability
 		virtual std::vector<DSIGlobalSettingDefinition> dsiGlobalSettings() const;
+		// Values that come from the synth are applied as one batch, and not echoed back as NRPNs
+		virtual void setGlobalSettingsFromDataFile(std::shared_ptr<DataFile> dataFile) override;
+
+		// Sends a single change message for each batch of global settings updates that changed anything. Listeners of the globalSettingsTree_ see every changed
+		// value on the thread that applied it (e.g. the MIDI thread), so UI that wants one callback on the message thread should listen here instead
+		ChangeBroadcaster &globalSettingsChanges();
+
+		// Apply a complete global settings dump (0x0f) to the synth, sending NRPNs only for those values that differ from the current globalSettings_.
+		// Returns the settings that could not be applied, because the OB-6 does not accept the target value via NRPN (see the bug list in OB6.cpp),
+		// or because an earlier change in the same push (MIDI Control off, Param Rcv not NRPN) stops the synth from hearing it
+		std::vector<std::shared_ptr<TypedNamedValue>> pushGlobalSettings(MidiController *controller, std::shared_ptr<DataFile> targetSettings);
+		std::vector<std::shared_ptr<TypedNamedValue>> pushGlobalSettings(std::shared_ptr<DataFile> targetSettings, std::function<void(std::vector<MidiMessage> const &)> sendMessages);
+
+		// The NRPN messages to set a single program parameter in the edit buffer
+		std::vector<MidiMessage> createProgramParameterNRPN(int parameterNo, int value);
+
+		// A hash over the voice relevant data of a patch as returned by filterVoiceRelevantData, i.e. ignoring the name
+		uint64 voiceFingerprint(std::shared_ptr<DataFile> patch) const;
+
+		// Edit buffer shadow - remembers the fingerprint of what was last sent to or received from the edit buffer. patchToSysex invalidates it
+		bool isInEditBuffer(std::shared_ptr<DataFile> patch) const;
+		// Like patchToSysex, but returns no messages at all when the patch is already in the edit buffer
+		std::vector<MidiMessage> patchToSysexIfChanged(std::shared_ptr<DataFile> patch);
+		void setEditBufferShadow(std::shared_ptr<DataFile> patch);
+		void invalidateEditBufferShadow();
+		// Feed all messages coming from the synth here. Edit buffer dumps update the shadow, program changes and NRPN edits invalidate it
+		void handleIncomingMessage(MidiMessage const &message);
 
 	private:
+		// Applies values that came from the synth. Only the values set through the batch are not echoed back as NRPNs, so edits made on other threads
+		// at the same time are still sent. The globalSettingsChanges() broadcaster is notified once when the batch ends
+		class GlobalSettingsBatch {
+		public:
+			GlobalSettingsBatch(OB6 &synth);
+			~GlobalSettingsBatch();
+
+			void set(size_t index, int value);
+
+		private:
+			OB6 &synth_;
+			bool changed_ = false;
+		};
+
+		// Sits between globalSettingsTree_ and the DSISynth listener that sends the NRPNs, and drops the changes a GlobalSettingsBatch is making
+		class GlobalSettingsEchoFilter : public ValueTree::Listener {
+		public:
+			GlobalSettingsEchoFilter(OB6 &synth);
+			virtual void valueTreePropertyChanged(ValueTree &treeWhosePropertyHasChanged, const Identifier &property) override;
+
+		private:
+			OB6 &synth_;
+		};
+
+		static bool isKindOfDataType(MessageKind kind, int dataTypeID);
+
 		void initGlobalSettings();
 		MidiMessage requestGlobalSettingsDump() const;
 		bool isGlobalSettingsDump(MidiMessage const &message) const;
+		int updateGlobalSettingsFromDump(const uint8 *sysexData, size_t sysexSize);
 
-		
+		ChangeBroadcaster globalSettingsChanged_;
+		GlobalSettingsEchoFilter globalSettingsEchoFilter_{ *this };
+		mutable std::atomic<uint64> editBufferFingerprint_{ 0 }; // 0 means unknown, cleared by every edit buffer dump created outside patchToSysexIfChanged
 	};
 
 }
@@ -0,0 +1,76 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6Audition.h"
+
+#include "OB6ProgramLayout.h"
+
+namespace midikraft {
+
+	OB6Audition::OB6Audition(std::shared_ptr<OB6> synth, std::shared_ptr<OB6Transport> transport) : synth_(synth), transport_(transport)
+	{
+	}
+
+	OB6Audition::Report OB6Audition::audition(std::shared_ptr<DataFile> patch)
+	{
+		auto const &data = patch->data();
+
+		// Only when the synth's shadow still agrees with what we sent last do we know what is in the edit buffer.
+		// Check before creating the full dump, because creating it invalidates the shadow
+		bool editBufferKnown = editBuffer_ && synth_->isInEditBuffer(editBuffer_);
+		bool unchanged = editBufferKnown && synth_->isInEditBuffer(patch) && editBuffer_->data() == data;
+
+		auto fullDump = synth_->patchToSysex(patch);
+		int fullDumpBytes = OB6Transport::byteCount(fullDump);
+		if (unchanged) {
+			synth_->setEditBufferShadow(editBuffer_);
+			return { true, 0, 0, fullDumpBytes, 0.0, 0.0 };
+		}
+
+		// Build the NRPN alternative, but only if we know what is in the edit buffer and the difference is reachable via NRPN at all
+		std::vector<MidiMessage> nrpns;
+		int changedParameters = 0;
+		int nrpnBytes = 0;
+		bool nrpnPossible = editBufferKnown && editBuffer_->data().size() == data.size();
+		for (size_t i = 0; nrpnPossible && i < data.size(); i++) {
+			if (data[i] != editBuffer_->data()[i]) {
+				if (!isOB6NRPNAddressable(i)) {
+					// E.g. the sequencer, this can only be sent as a dump
+					nrpnPossible = false;
+					break;
+				}
+				auto nrpn = synth_->createProgramParameterNRPN((int)i, data[i]);
+				std::copy(nrpn.begin(), nrpn.end(), std::back_inserter(nrpns));
+				nrpnBytes += OB6Transport::byteCount(nrpn);
+				changedParameters++;
+				if (nrpnBytes >= fullDumpBytes) {
+					// The crossover point is reached, the full dump is cheaper
+					nrpnPossible = false;
+				}
+			}
+		}
+
+		auto const &messages = nrpnPossible ? nrpns : fullDump;
+		double start = Time::getMillisecondCounterHiRes();
+		if (!messages.empty()) {
+			transport_->send(messages);
+		}
+		double sendMilliseconds = Time::getMillisecondCounterHiRes() - start;
+
+		// Keep a copy, the caller might continue to edit the patch
+		editBuffer_ = synth_->patchFromPatchData(data, MidiProgramNumber::fromZeroBase(0));
+		synth_->setEditBufferShadow(editBuffer_);
+
+		int bytesSent = OB6Transport::byteCount(messages);
+		return { nrpnPossible, changedParameters, bytesSent, fullDumpBytes, OB6Transport::dinMilliseconds(bytesSent), sendMilliseconds };
+	}
+
+	void OB6Audition::invalidate()
+	{
+		editBuffer_.reset();
+	}
+
+}
@@ -0,0 +1,41 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "OB6.h"
+#include "OB6Transport.h"
+
+namespace midikraft {
+
+	// Auditioning of patches with as little MIDI traffic as possible. The audition remembers what is in the OB-6's edit buffer,
+	// and sends only the changed parameters as NRPNs when that is cheaper than the full edit buffer dump. The OB6's edit buffer shadow
+	// decides whether that memory is still valid, and if the patch is already in the edit buffer nothing is sent at all
+	class OB6Audition {
+	public:
+		struct Report {
+			bool sentAsNRPN;
+			int changedParameters;
+			int bytesSent;
+			int fullDumpBytes;
+			double estimatedDINMilliseconds; // Time to sound when connected via 5-pin DIN at 31250 baud
+			double sendMilliseconds; // Time spent handing the messages to the transport
+		};
+
+		OB6Audition(std::shared_ptr<OB6> synth, std::shared_ptr<OB6Transport> transport);
+
+		Report audition(std::shared_ptr<DataFile> patch);
+
+		// Call this when the edit buffer might have been changed behind our back, the next audition will then send the full dump
+		void invalidate();
+
+	private:
+		std::shared_ptr<OB6> synth_;
+		std::shared_ptr<OB6Transport> transport_;
+		std::shared_ptr<DataFile> editBuffer_;
+	};
+
+}
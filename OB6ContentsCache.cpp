@@ -0,0 +1,114 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6ContentsCache.h"
+
+#include "OB6Hash.h"
+#include "OB6Storage.h"
+
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <random>
+
+namespace midikraft {
+
+	const int kOB6CacheMagic = 0x4f423643; // "OB6C"
+	const int kOB6CacheVersion = 1;
+	const int kOB6CacheProgramSize = 1024;
+
+	OB6ContentsCache::OB6ContentsCache(File const &directory) : directory_(directory)
+	{
+	}
+
+	std::string OB6ContentsCache::deviceIdentity(std::string const &outputName, std::shared_ptr<DataFile> globalSettings)
+	{
+		int channel = 0;
+		if (globalSettings && globalSettings->data().size() > 5) {
+			channel = globalSettings->data()[3 + 2 /* MIDI channel */];
+		}
+		return (boost::format("%s-%d") % outputName % channel).str();
+	}
+
+	bool OB6ContentsCache::save(std::string const &identity, OB6DeviceContents const &contents) const
+	{
+		return ob6WriteFileReplacing(fileFor(identity), [&contents](OutputStream &out) {
+			out.writeInt(kOB6CacheMagic);
+			out.writeInt(kOB6CacheVersion);
+			out.writeInt(contents.numberOfSlots());
+			for (int i = 0; i < contents.numberOfSlots(); i++) {
+				auto program = contents.program(i);
+				bool known = program && program->data().size() == kOB6CacheProgramSize;
+				out.writeByte(known ? 1 : 0);
+				if (known) {
+					out.write(program->data().data(), program->data().size());
+				}
+			}
+		});
+	}
+
+	bool OB6ContentsCache::load(std::string const &identity, OB6DeviceContents &contents) const
+	{
+		File file = fileFor(identity);
+		if (!file.existsAsFile()) {
+			return false;
+		}
+		FileInputStream in(file);
+		if (!in.openedOk() || in.readInt() != kOB6CacheMagic || in.readInt() != kOB6CacheVersion || in.readInt() != contents.numberOfSlots()) {
+			return false;
+		}
+		contents.forgetAll();
+		for (int i = 0; i < contents.numberOfSlots(); i++) {
+			if (in.readByte() == 1) {
+				Synth::PatchData data(kOB6CacheProgramSize);
+				if (in.read(data.data(), kOB6CacheProgramSize) != kOB6CacheProgramSize) {
+					contents.forgetAll();
+					return false;
+				}
+				contents.remember(i, contents.synth()->patchFromPatchData(data, MidiProgramNumber::fromZeroBase(i)));
+			}
+		}
+		return true;
+	}
+
+	bool OB6ContentsCache::isFresh(OB6DeviceContents const &contents, OB6Requester &requester, int samples) const
+	{
+		std::vector<int> known;
+		for (int i = 0; i < contents.numberOfSlots(); i++) {
+			if (contents.isKnown(i)) {
+				known.push_back(i);
+			}
+		}
+		if (known.empty()) {
+			return false;
+		}
+
+		std::mt19937 random(std::random_device{}());
+		std::shuffle(known.begin(), known.end(), random);
+		known.resize(std::min(known.size(), (size_t)samples));
+
+		// Request all samples at once, and only then wait for them
+		std::vector<std::future<std::shared_ptr<DataFile>>> replies;
+		for (int programNo : known) {
+			replies.push_back(requester.fetchProgram(MidiProgramNumber::fromZeroBase(programNo)));
+		}
+		bool fresh = true;
+		for (size_t i = 0; i < known.size(); i++) {
+			auto program = replies[i].get();
+			if (!program || OB6DeviceContents::slotFingerprint(*contents.synth(), program) != contents.fingerprint(known[i])) {
+				fresh = false;
+			}
+		}
+		return fresh;
+	}
+
+	File OB6ContentsCache::fileFor(std::string const &identity) const
+	{
+		// Port names can contain anything, so use a hash for the file name
+		return directory_.getChildFile((boost::format("ob6-%016x.cache") % ob6Hash(identity)).str());
+	}
+
+}
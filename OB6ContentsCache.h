@@ -0,0 +1,35 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "OB6DeltaSync.h"
+#include "OB6Requester.h"
+
+namespace midikraft {
+
+	// Persists the known program slots of each OB-6 between sessions, so the programs need not be downloaded again on every connect.
+	// Before trusting the cache, a few random slots are requested from the synth and compared by fingerprint
+	class OB6ContentsCache {
+	public:
+		OB6ContentsCache(File const &directory);
+
+		// The OB-6 has no serial number, so the identity is built from the port and the MIDI channel reported in the global dump
+		static std::string deviceIdentity(std::string const &outputName, std::shared_ptr<DataFile> globalSettings);
+
+		bool save(std::string const &identity, OB6DeviceContents const &contents) const;
+		bool load(std::string const &identity, OB6DeviceContents &contents) const;
+
+		// Blocks until all samples have arrived or timed out, don't call from the MIDI thread. Only slots known in the contents are sampled
+		bool isFresh(OB6DeviceContents const &contents, OB6Requester &requester, int samples = 4) const;
+
+	private:
+		File fileFor(std::string const &identity) const;
+
+		File directory_;
+	};
+
+}
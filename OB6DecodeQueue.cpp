@@ -0,0 +1,86 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6DecodeQueue.h"
+
+#include <chrono>
+
+namespace midikraft {
+
+	OB6DecodeQueue::OB6DecodeQueue(Decoder decoder) : decoder_(decoder), slots_(new Slot[kSlotCount])
+	{
+		worker_ = std::thread([this]() { run(); });
+	}
+
+	OB6DecodeQueue::~OB6DecodeQueue()
+	{
+		shouldExit_ = true;
+		wake_.notify_one();
+		worker_.join();
+	}
+
+	bool OB6DecodeQueue::push(MidiMessage const &message)
+	{
+		size_t size = (size_t)message.getRawDataSize();
+		size_t head = head_.load(std::memory_order_relaxed);
+		size_t tail = tail_.load(std::memory_order_acquire);
+		if (size > kMaxMessageSize || head - tail >= kSlotCount) {
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		Slot &slot = slots_[head % kSlotCount];
+		slot.size = size;
+		std::memcpy(slot.data.data(), message.getRawData(), size);
+		head_.store(head + 1, std::memory_order_release);
+
+		size_t depth = head + 1 - tail;
+		if (depth > highWaterMark_.load(std::memory_order_relaxed)) {
+			highWaterMark_.store(depth, std::memory_order_relaxed);
+		}
+		// Notifying without holding the mutex can lose a wakeup, but the worker polls anyway
+		wake_.notify_one();
+		return true;
+	}
+
+	size_t OB6DecodeQueue::depth() const
+	{
+		return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+	}
+
+	size_t OB6DecodeQueue::highWaterMark() const
+	{
+		return highWaterMark_.load(std::memory_order_relaxed);
+	}
+
+	uint64 OB6DecodeQueue::dropped() const
+	{
+		return dropped_.load(std::memory_order_relaxed);
+	}
+
+	uint64 OB6DecodeQueue::decoded() const
+	{
+		return decoded_.load(std::memory_order_relaxed);
+	}
+
+	void OB6DecodeQueue::run()
+	{
+		while (!shouldExit_) {
+			size_t tail = tail_.load(std::memory_order_relaxed);
+			if (tail == head_.load(std::memory_order_acquire)) {
+				std::unique_lock<std::mutex> lock(wakeMutex_);
+				wake_.wait_for(lock, std::chrono::milliseconds(5));
+				continue;
+			}
+			Slot &slot = slots_[tail % kSlotCount];
+			MidiMessage message(slot.data.data(), (int)slot.size);
+			// Release the slot before decoding, the message has its own copy now
+			tail_.store(tail + 1, std::memory_order_release);
+			decoder_(message);
+			decoded_.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+}
@@ -0,0 +1,63 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace midikraft {
+
+	// Moves raw sysex messages from the MIDI callback thread to a dedicated decode thread, so decoding large dumps (patchFromSysex, loadData)
+	// never stalls MIDI input during bank transfers. This is a bounded single producer/single consumer ring: push() does not lock and does
+	// not allocate, and when the ring is full the message is dropped and counted instead of blocking the MIDI thread
+	class OB6DecodeQueue {
+	public:
+		typedef std::function<void(MidiMessage const &message)> Decoder;
+
+		// Large enough for an escaped program dump (5 header bytes + 1171 data bytes + F0/F7)
+		static const size_t kMaxMessageSize = 2048;
+		static const size_t kSlotCount = 128;
+
+		OB6DecodeQueue(Decoder decoder);
+		~OB6DecodeQueue();
+
+		// Producer side, never call this from two threads at the same time. Handlers of an OB6Transport are serialized, so they may push. Returns false if the message had to be dropped
+		bool push(MidiMessage const &message);
+
+		size_t depth() const;
+		size_t highWaterMark() const;
+		uint64 dropped() const;
+		uint64 decoded() const;
+
+	private:
+		struct Slot {
+			size_t size;
+			std::array<uint8, kMaxMessageSize> data;
+		};
+
+		void run();
+
+		Decoder decoder_;
+		std::unique_ptr<Slot[]> slots_; // Allocated once in the constructor
+		std::atomic<size_t> head_{ 0 }; // Next slot to write, only modified by the producer
+		std::atomic<size_t> tail_{ 0 }; // Next slot to read, only modified by the consumer
+		std::atomic<size_t> highWaterMark_{ 0 };
+		std::atomic<uint64> dropped_{ 0 };
+		std::atomic<uint64> decoded_{ 0 };
+
+		std::atomic<bool> shouldExit_{ false };
+		std::mutex wakeMutex_;
+		std::condition_variable wake_;
+		std::thread worker_;
+	};
+
+}
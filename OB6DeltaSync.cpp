@@ -0,0 +1,129 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6DeltaSync.h"
+
+#include "OB6Hash.h"
+#include "OB6Patch.h"
+
+#include <chrono>
+#include <thread>
+
+namespace midikraft {
+
+	OB6DeviceContents::OB6DeviceContents(std::shared_ptr<OB6> synth) : synth_(synth)
+	{
+		size_t slots = (size_t)(synth_->numberOfBanks() * synth_->numberOfPatches());
+		fingerprints_.resize(slots, 0);
+		programs_.resize(slots);
+	}
+
+	uint64 OB6DeviceContents::slotFingerprint(OB6 const &synth, std::shared_ptr<DataFile> patch)
+	{
+		// Continue the FNV-1a of the voice data with the name characters
+		uint64 hash = synth.voiceFingerprint(patch);
+		auto ob6Patch = std::dynamic_pointer_cast<OB6Patch>(patch);
+		if (ob6Patch) {
+			hash = ob6Hash(ob6Patch->name(), hash);
+		}
+		return hash == 0 ? 1 : hash;
+	}
+
+	std::shared_ptr<OB6> OB6DeviceContents::synth() const
+	{
+		return synth_;
+	}
+
+	int OB6DeviceContents::numberOfSlots() const
+	{
+		return (int)fingerprints_.size();
+	}
+
+	void OB6DeviceContents::remember(int programNo, std::shared_ptr<DataFile> patch)
+	{
+		if (programNo >= 0 && programNo < numberOfSlots() && patch) {
+			fingerprints_[(size_t)programNo] = slotFingerprint(*synth_, patch);
+			programs_[(size_t)programNo] = patch;
+		}
+	}
+
+	void OB6DeviceContents::forget(int programNo)
+	{
+		if (programNo >= 0 && programNo < numberOfSlots()) {
+			fingerprints_[(size_t)programNo] = 0;
+			programs_[(size_t)programNo].reset();
+		}
+	}
+
+	void OB6DeviceContents::forgetAll()
+	{
+		std::fill(fingerprints_.begin(), fingerprints_.end(), 0);
+		std::fill(programs_.begin(), programs_.end(), nullptr);
+	}
+
+	bool OB6DeviceContents::isKnown(int programNo) const
+	{
+		return fingerprint(programNo) != 0;
+	}
+
+	uint64 OB6DeviceContents::fingerprint(int programNo) const
+	{
+		return programNo >= 0 && programNo < numberOfSlots() ? fingerprints_[(size_t)programNo] : 0;
+	}
+
+	std::shared_ptr<DataFile> OB6DeviceContents::program(int programNo) const
+	{
+		return programNo >= 0 && programNo < numberOfSlots() ? programs_[(size_t)programNo] : nullptr;
+	}
+
+	OB6DeltaSync::OB6DeltaSync(std::shared_ptr<OB6> synth, std::shared_ptr<OB6Transport> transport, OB6DeviceContents &contents) :
+		synth_(synth), transport_(transport), contents_(contents)
+	{
+	}
+
+	std::vector<std::shared_ptr<DataFile>> OB6DeltaSync::differingPrograms(std::vector<std::shared_ptr<DataFile>> const &targetBank) const
+	{
+		std::vector<std::shared_ptr<DataFile>> result;
+		for (auto const &target : targetBank) {
+			auto patch = std::dynamic_pointer_cast<Patch>(target);
+			if (!patch) continue;
+			int programNo = patch->patchNumber().toZeroBased();
+			// Unknown slots have fingerprint 0, which never matches
+			if (contents_.fingerprint(programNo) != OB6DeviceContents::slotFingerprint(*synth_, patch)) {
+				result.push_back(patch);
+			}
+		}
+		return result;
+	}
+
+	OB6DeltaSync::Report OB6DeltaSync::sync(std::vector<std::shared_ptr<DataFile>> const &targetBank, int gapMilliseconds)
+	{
+		Report report = { 0, 0, 0, 0, 0.0, 0.0 };
+		double start = Time::getMillisecondCounterHiRes();
+		for (auto const &target : targetBank) {
+			auto patch = std::dynamic_pointer_cast<Patch>(target);
+			if (!patch) continue;
+			report.slotsCompared++;
+			int programNo = patch->patchNumber().toZeroBased();
+			auto messages = synth_->patchToProgramDumpSysex(patch, patch->patchNumber());
+			int bytes = OB6Transport::byteCount(messages);
+			if (contents_.fingerprint(programNo) == OB6DeviceContents::slotFingerprint(*synth_, patch)) {
+				report.bytesSaved += bytes;
+				report.dinMillisecondsSaved += OB6Transport::dinMilliseconds(bytes) + gapMilliseconds;
+				continue;
+			}
+			transport_->send(messages);
+			contents_.remember(programNo, patch);
+			report.slotsSent++;
+			report.bytesSent += bytes;
+			// The OB-6 needs time to store the program, else it drops the next dump
+			std::this_thread::sleep_for(std::chrono::milliseconds(gapMilliseconds));
+		}
+		report.milliseconds = Time::getMillisecondCounterHiRes() - start;
+		return report;
+	}
+
+}
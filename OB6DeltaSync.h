@@ -0,0 +1,62 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "OB6.h"
+#include "OB6Transport.h"
+
+namespace midikraft {
+
+	// What we believe is stored in the program slots of one OB-6, as learned from backups, received program dumps and our own writes
+	class OB6DeviceContents {
+	public:
+		OB6DeviceContents(std::shared_ptr<OB6> synth);
+
+		// The voice fingerprint extended by the name bytes, as the name is stored in the slot as well
+		static uint64 slotFingerprint(OB6 const &synth, std::shared_ptr<DataFile> patch);
+
+		std::shared_ptr<OB6> synth() const;
+		int numberOfSlots() const;
+		void remember(int programNo, std::shared_ptr<DataFile> patch);
+		void forget(int programNo);
+		void forgetAll();
+
+		bool isKnown(int programNo) const;
+		uint64 fingerprint(int programNo) const;
+		std::shared_ptr<DataFile> program(int programNo) const;
+
+	private:
+		std::shared_ptr<OB6> synth_;
+		std::vector<uint64> fingerprints_; // 0 means unknown
+		std::vector<std::shared_ptr<DataFile>> programs_;
+	};
+
+	// Writes a bank of programs to the OB-6, skipping all slots that already contain the same program
+	class OB6DeltaSync {
+	public:
+		struct Report {
+			int slotsCompared;
+			int slotsSent;
+			int bytesSent;
+			int bytesSaved;
+			double dinMillisecondsSaved; // Transfer time saved over 5-pin DIN, including the pause after each program
+			double milliseconds;
+		};
+
+		OB6DeltaSync(std::shared_ptr<OB6> synth, std::shared_ptr<OB6Transport> transport, OB6DeviceContents &contents);
+
+		// The target programs are written to the slots given by their patch number
+		std::vector<std::shared_ptr<DataFile>> differingPrograms(std::vector<std::shared_ptr<DataFile>> const &targetBank) const;
+		Report sync(std::vector<std::shared_ptr<DataFile>> const &targetBank, int gapMilliseconds = 20);
+
+	private:
+		std::shared_ptr<OB6> synth_;
+		std::shared_ptr<OB6Transport> transport_;
+		OB6DeviceContents &contents_;
+	};
+
+}
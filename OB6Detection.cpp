@@ -0,0 +1,169 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6Detection.h"
+
+#include "MidiController.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace midikraft {
+
+	OB6Detector::OB6Detector(std::shared_ptr<OB6> synth, MidiController *controller) : synth_(synth), controller_(controller)
+	{
+	}
+
+	std::vector<OB6Detector::Detection> OB6Detector::detect(std::vector<std::string> const &inputs, std::vector<std::string> const &outputs, int timeoutMilliseconds)
+	{
+		timing_ = Timing();
+		double start = Time::getMillisecondCounterHiRes();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			listeningTo_ = std::set<std::string>(inputs.begin(), inputs.end());
+		}
+		for (auto const &input : inputs) {
+			controller_->enableMidiInput(input);
+		}
+		auto handle = MidiController::makeOneHandle();
+		controller_->addMessageHandler(handle, [this](MidiInput *source, MidiMessage const &message) {
+			handleMessage(source, message);
+		});
+
+		// First round - everybody gets the request, and we learn which inputs have an OB-6 behind them
+		auto firstReplies = runRound(outputs, listeningTo_, timeoutMilliseconds);
+		timing_.firstRoundMilliseconds = Time::getMillisecondCounterHiRes() - start;
+
+		std::set<std::string> responders;
+		double slowestReply = 0.0;
+		for (auto const &reply : firstReplies) {
+			responders.insert(reply.first);
+			slowestReply = std::max(slowestReply, reply.second.milliseconds);
+		}
+
+		// Pairing rounds - in round b, only the outputs with bit b set in their index send. Each responding input thus collects the index of its output bit by bit.
+		// If only one output exists, there is nothing to find out
+		std::map<std::string, size_t> outputIndex;
+		if (!responders.empty() && outputs.size() > 1) {
+			double pairingStart = Time::getMillisecondCounterHiRes();
+			double pairingTimeout = std::min((double) timeoutMilliseconds, std::max(20.0, 3.0 * slowestReply));
+			for (size_t bit = 0; (size_t(1) << bit) < outputs.size(); bit++) {
+				std::vector<std::string> group;
+				for (size_t i = 0; i < outputs.size(); i++) {
+					if (i & (size_t(1) << bit)) {
+						group.push_back(outputs[i]);
+					}
+				}
+				auto replies = runRound(group, responders, pairingTimeout, pairingTimeout);
+				for (auto const &reply : replies) {
+					outputIndex[reply.first] |= size_t(1) << bit;
+				}
+			}
+
+			// A reply slower than the pairing timeout is lost and clears a bit, so confirm each pairing by sending on the chosen output alone.
+			// The input must answer, and no other input may (that would be an input hearing more than one output). These rounds run to their deadline,
+			// so a second input hearing the same output gets the time to answer
+			std::map<size_t, std::set<std::string>> pairedInputs;
+			for (auto const &responder : responders) {
+				size_t index = outputIndex[responder];
+				if (index < outputs.size()) {
+					pairedInputs[index].insert(responder);
+				}
+			}
+			std::set<std::string> confirmed;
+			std::set<std::string> ambiguous;
+			for (auto const &paired : pairedInputs) {
+				auto replies = runRound({ outputs[paired.first] }, {}, pairingTimeout, pairingTimeout);
+				for (auto const &reply : replies) {
+					if (paired.second.find(reply.first) != paired.second.end()) {
+						confirmed.insert(reply.first);
+					}
+					else {
+						ambiguous.insert(reply.first);
+					}
+				}
+			}
+			for (auto const &responder : responders) {
+				if (confirmed.find(responder) == confirmed.end() || ambiguous.find(responder) != ambiguous.end()) {
+					outputIndex[responder] = outputs.size();
+				}
+			}
+			timing_.pairingMilliseconds = Time::getMillisecondCounterHiRes() - pairingStart;
+		}
+
+		controller_->removeMessageHandler(handle);
+
+		std::vector<Detection> result;
+		for (auto const &responder : responders) {
+			size_t index = outputIndex[responder];
+			if (index >= outputs.size()) {
+				// The input heard more than one output (e.g. a MIDI thru chain), or the pairing could not be confirmed
+				continue;
+			}
+			auto const &reply = firstReplies[responder];
+			result.push_back({ responder, outputs[index], reply.channel, reply.milliseconds });
+		}
+		timing_.totalMilliseconds = Time::getMillisecondCounterHiRes() - start;
+		return result;
+	}
+
+	OB6Detector::Timing OB6Detector::lastTiming() const
+	{
+		return timing_;
+	}
+
+	std::map<std::string, OB6Detector::Reply> OB6Detector::runRound(std::vector<std::string> const &outputs, std::set<std::string> const &expectedInputs, double timeoutMilliseconds, double quietMilliseconds)
+	{
+		if (quietMilliseconds > 0.0) {
+			// No round is open, so whatever arrives now is dropped
+			std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(quietMilliseconds));
+		}
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		replies_.clear();
+		roundOpen_ = true;
+		roundStart_ = Time::getMillisecondCounterHiRes();
+		lock.unlock();
+
+		auto request = synth_->deviceDetect(0);
+		for (auto const &output : outputs) {
+			controller_->getMidiOutput(output)->sendBlockOfMessagesFullSpeed(request);
+			timing_.requestsSent++;
+		}
+		timing_.rounds++;
+
+		lock.lock();
+		repliesArrived_.wait_for(lock, std::chrono::duration<double, std::milli>(timeoutMilliseconds), [this, &expectedInputs]() {
+			return !expectedInputs.empty() && std::all_of(expectedInputs.begin(), expectedInputs.end(), [this](std::string const &input) { return replies_.find(input) != replies_.end(); });
+		});
+		// Round over, anything arriving from now on belongs to no round
+		roundOpen_ = false;
+		auto result = replies_;
+		replies_.clear();
+		return result;
+	}
+
+	void OB6Detector::handleMessage(MidiInput *source, MidiMessage const &message)
+	{
+		// Called on the MIDI thread, keep it short
+		if (!source || !message.isSysEx()) {
+			return;
+		}
+		auto channel = synth_->channelFromGlobalSettingsDump(message);
+		if (!channel.isValid()) {
+			return;
+		}
+		std::string input = source->getName().toStdString();
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (roundOpen_ && listeningTo_.find(input) != listeningTo_.end() && replies_.find(input) == replies_.end()) {
+			replies_.emplace(input, Reply({ channel, Time::getMillisecondCounterHiRes() - roundStart_ }));
+			repliesArrived_.notify_all();
+		}
+	}
+
+}
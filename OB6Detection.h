@@ -0,0 +1,68 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "OB6.h"
+
+#include <condition_variable>
+#include <mutex>
+
+namespace midikraft {
+
+	// Concurrent detection of OB-6 units on many MIDI ports. Instead of probing one port after the other, the global parameter request (0x0e)
+	// is sent on all outputs at once, and the 0x0f replies are collected from all inputs by a single MIDI handler.
+	// To find out which output belongs to which responding input, the outputs are then bisected by their index bits, which needs only
+	// log2(number of outputs) more rounds instead of one round per output. Each pairing found is finally confirmed by probing its output alone.
+	class OB6Detector {
+	public:
+		struct Detection {
+			std::string input;
+			std::string output;
+			MidiChannel channel;
+			double replyMilliseconds; // Round trip time of the first request
+		};
+
+		struct Timing {
+			double totalMilliseconds = 0.0;
+			double firstRoundMilliseconds = 0.0;
+			double pairingMilliseconds = 0.0;
+			int rounds = 0;
+			int requestsSent = 0;
+		};
+
+		OB6Detector(std::shared_ptr<OB6> synth, MidiController *controller);
+
+		// Blocks until done, so this must not be called on the MIDI thread.
+		// The timeout applies to each round, and is shortened for the pairing rounds once the reply times of the first round are known
+		std::vector<Detection> detect(std::vector<std::string> const &inputs, std::vector<std::string> const &outputs, int timeoutMilliseconds = 200);
+
+		Timing lastTiming() const;
+
+	private:
+		struct Reply {
+			MidiChannel channel;
+			double milliseconds;
+		};
+
+		// Send the request on the given outputs, and wait until all expected inputs have replied or the timeout expires. With no expected inputs, the round always
+		// lasts until the timeout. The quiet period before sending drops the stragglers of the previous round, which would otherwise be counted in this one
+		std::map<std::string, Reply> runRound(std::vector<std::string> const &outputs, std::set<std::string> const &expectedInputs, double timeoutMilliseconds, double quietMilliseconds = 0.0);
+		void handleMessage(MidiInput *source, MidiMessage const &message);
+
+		std::shared_ptr<OB6> synth_;
+		MidiController *controller_;
+		Timing timing_;
+
+		std::mutex mutex_;
+		std::condition_variable repliesArrived_;
+		std::set<std::string> listeningTo_;
+		std::map<std::string, Reply> replies_;
+		double roundStart_ = 0.0;
+		bool roundOpen_ = false; // Replies arriving between rounds are dropped
+	};
+
+}
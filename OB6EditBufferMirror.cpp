@@ -0,0 +1,82 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6EditBufferMirror.h"
+
+namespace midikraft {
+
+	OB6EditBufferMirror::OB6EditBufferMirror(std::shared_ptr<OB6> synth) : synth_(synth), image_(kOB6ProgramSize, 0)
+	{
+	}
+
+	bool OB6EditBufferMirror::handleIncomingMessage(MidiMessage const &message)
+	{
+		if (message.isSysEx()) {
+			if (synth_->classifyMessage(message) == OB6::MessageKind::EDIT_BUFFER_DUMP) {
+				auto patch = synth_->patchFromSysex(message);
+				if (patch && patch->data().size() == kOB6ProgramSize) {
+					std::lock_guard<std::mutex> lock(mutex_);
+					image_ = patch->data();
+					synchronized_ = true;
+					return true;
+				}
+			}
+			return false;
+		}
+		if (message.isProgramChange()) {
+			// A new program was loaded into the edit buffer, and we don't know which one
+			std::lock_guard<std::mutex> lock(mutex_);
+			synchronized_ = false;
+			return false;
+		}
+		if (message.isController() && message.getChannel() == synth_->channel().toOneBasedInt()) {
+			// The OB-6 transmits an NRPN as CC 99, 98, 6 and 38, with the data entry LSB completing the message
+			std::lock_guard<std::mutex> lock(mutex_);
+			switch (message.getControllerNumber()) {
+			case 99: parameterMSB_ = message.getControllerValue(); break;
+			case 98: parameterLSB_ = message.getControllerValue(); break;
+			case 6: valueMSB_ = message.getControllerValue(); break;
+			case 38: return applyNRPN((parameterMSB_ << 7) | parameterLSB_, (valueMSB_ << 7) | message.getControllerValue());
+			default: break;
+			}
+		}
+		return false;
+	}
+
+	bool OB6EditBufferMirror::isSynchronized() const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return synchronized_;
+	}
+
+	std::vector<MidiMessage> OB6EditBufferMirror::resyncRequest() const
+	{
+		return { synth_->requestEditBufferDump() };
+	}
+
+	uint8 OB6EditBufferMirror::parameter(OB6Parameter param) const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return image_[param];
+	}
+
+	std::shared_ptr<DataFile> OB6EditBufferMirror::snapshot() const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return synth_->patchFromPatchData(image_, MidiProgramNumber::fromZeroBase(0));
+	}
+
+	bool OB6EditBufferMirror::applyNRPN(int parameterNo, int value)
+	{
+		// Program parameters map 1:1 to the bytes of the unpacked program data. Everything from 1024 on is a global setting
+		if (parameterNo < 0 || parameterNo >= (int)kOB6ProgramSize || image_[(size_t)parameterNo] == value) {
+			return false;
+		}
+		image_[(size_t)parameterNo] = (uint8)value;
+		return true;
+	}
+
+}
@@ -0,0 +1,45 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "OB6.h"
+#include "OB6ProgramLayout.h"
+
+#include <mutex>
+
+namespace midikraft {
+
+	// A live copy of the OB-6's edit buffer. With "MIDI Param Xmit" set to NRPN, the synth transmits every front panel edit,
+	// and each of these NRPNs is applied directly to the unpacked program image. A full edit buffer dump is only needed to (re)synchronize,
+	// i.e. at the start and after a program change
+	class OB6EditBufferMirror {
+	public:
+		OB6EditBufferMirror(std::shared_ptr<OB6> synth);
+
+		// Feed all messages coming from the synth, returns true if the mirror changed. Safe to call on the MIDI thread
+		bool handleIncomingMessage(MidiMessage const &message);
+
+		// False until the first edit buffer dump was received, and again after a program change
+		bool isSynchronized() const;
+		std::vector<MidiMessage> resyncRequest() const;
+
+		uint8 parameter(OB6Parameter param) const;
+		std::shared_ptr<DataFile> snapshot() const;
+
+	private:
+		bool applyNRPN(int parameterNo, int value);
+
+		std::shared_ptr<OB6> synth_;
+		mutable std::mutex mutex_;
+		Synth::PatchData image_;
+		bool synchronized_ = false;
+		int parameterMSB_ = 0;
+		int parameterLSB_ = 0;
+		int valueMSB_ = 0;
+	};
+
+}
@@ -0,0 +1,28 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+namespace midikraft {
+
+	const uint64 kOB6HashStart = 14695981039346656037ULL;
+
+	// 64 bit FNV-1a, good enough to tell patches apart and cheap to compute. Pass a previous result as start to continue a hash
+	inline uint64 ob6Hash(const uint8 *data, size_t size, uint64 start = kOB6HashStart) {
+		uint64 hash = start;
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ data[i]) * 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	inline uint64 ob6Hash(std::string const &text, uint64 start = kOB6HashStart) {
+		return ob6Hash(reinterpret_cast<const uint8 *>(text.data()), text.size(), start);
+	}
+
+}
@@ -0,0 +1,172 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6Morph.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace midikraft {
+
+	// Parameters with fewer steps than this are switched at the halfway point
+	const int kOB6MorphMinimumContinuousRange = 16;
+	// Leave some room on the wire for notes and controllers played at the same time
+	const double kOB6MorphBandwidthShare = 0.8;
+
+	// True if the programs agree in all bytes that are neither a layout parameter nor part of the name
+	static bool onlyMorphableDifferences(OB6Patch const &from, OB6Patch const &to) {
+		auto const &a = from.data();
+		auto const &b = to.data();
+		if (a.size() != b.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < a.size(); i++) {
+			if (a[i] != b[i] && !isOB6NRPNAddressable(i)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	OB6MorphEngine::OB6MorphEngine(std::shared_ptr<OB6> synth, std::shared_ptr<OB6Transport> transport, int tickMilliseconds) :
+		Thread("OB6MorphEngine"), synth_(synth), transport_(transport), tickMilliseconds_(tickMilliseconds)
+	{
+		// 31250 baud are 3125 bytes per second
+		bytesPerTick_ = 3125.0 * tickMilliseconds_ / 1000.0 * kOB6MorphBandwidthShare;
+		nrpnBytes_ = OB6Transport::byteCount(synth_->createProgramParameterNRPN(0, 0));
+		lastSent_.fill(-1);
+		statistics_ = { 0, 0, 0, 0.0, 0.0 };
+	}
+
+	OB6MorphEngine::~OB6MorphEngine()
+	{
+		stopThread(1000);
+	}
+
+	void OB6MorphEngine::start(std::shared_ptr<OB6Patch> from, std::shared_ptr<OB6Patch> to, double durationMilliseconds)
+	{
+		stop();
+		auto dump = synth_->patchToSysex(from);
+		transport_->send(dump);
+		synth_->setEditBufferShadow(from);
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			// No NRPNs until the dump has left the wire, which takes about 380 ms on DIN
+			byteBudget_ = -OB6Transport::byteCount(dump) * kOB6MorphBandwidthShare;
+			from_ = from;
+			to_ = to;
+			durationMilliseconds_ = std::max(1.0, durationMilliseconds);
+			for (size_t i = 0; i < kOB6NumberOfParameters; i++) {
+				lastSent_[i] = from->parameter(kOB6ParameterLayout[i].parameter);
+			}
+			statistics_ = { 0, 0, 0, 0.0, 0.0 };
+			jitterSum_ = 0.0;
+		}
+		startThread(9);
+	}
+
+	void OB6MorphEngine::stop()
+	{
+		stopThread(1000);
+	}
+
+	bool OB6MorphEngine::isMorphing() const
+	{
+		return isThreadRunning();
+	}
+
+	OB6MorphEngine::Statistics OB6MorphEngine::statistics() const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return statistics_;
+	}
+
+	void OB6MorphEngine::run()
+	{
+		double start = Time::getMillisecondCounterHiRes();
+		double nextTick = start;
+		while (!threadShouldExit()) {
+			// Sleep most of the way, and spin the last millisecond for a precise tick
+			double now = Time::getMillisecondCounterHiRes();
+			if (nextTick - now > 1.5) {
+				wait((int)(nextTick - now - 1.0));
+				continue;
+			}
+			while (Time::getMillisecondCounterHiRes() < nextTick) {
+				Thread::yield();
+			}
+			now = Time::getMillisecondCounterHiRes();
+			double jitter = now - nextTick;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				statistics_.ticks++;
+				jitterSum_ += jitter;
+				statistics_.meanJitterMilliseconds = jitterSum_ / statistics_.ticks;
+				statistics_.maxJitterMilliseconds = std::max(statistics_.maxJitterMilliseconds, jitter);
+			}
+			// Done when the end is reached and nothing is left to send
+			if (!tick(now - start)) {
+				break;
+			}
+			nextTick += tickMilliseconds_;
+		}
+	}
+
+	bool OB6MorphEngine::tick(double elapsedMilliseconds)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		double position = std::min(1.0, elapsedMilliseconds / durationMilliseconds_);
+
+		struct Change {
+			size_t index;
+			int value;
+			double perceived; // Change relative to the parameter's range
+		};
+		std::vector<Change> changes;
+		for (size_t i = 0; i < kOB6NumberOfParameters; i++) {
+			auto const &definition = kOB6ParameterLayout[i];
+			int from = from_->parameter(definition.parameter);
+			int to = to_->parameter(definition.parameter);
+			int value;
+			if (definition.range() < kOB6MorphMinimumContinuousRange) {
+				value = position < 0.5 ? from : to;
+			}
+			else {
+				value = (int)std::lround(from + (to - from) * position);
+			}
+			if (value != lastSent_[i]) {
+				changes.push_back({ i, value, std::abs(value - lastSent_[i]) / (double)std::max(1, definition.range()) });
+			}
+		}
+		std::sort(changes.begin(), changes.end(), [](Change const &a, Change const &b) { return a.perceived > b.perceived; });
+
+		// Unused budget carries over to the next tick, so with short ticks an NRPN goes out every few ticks. It is capped at one tick
+		// (or one NRPN, if that is larger), else an idle phase would allow a burst above the DIN rate
+		byteBudget_ = std::min(byteBudget_ + bytesPerTick_, std::max(bytesPerTick_, (double)nrpnBytes_));
+		std::vector<MidiMessage> messages;
+		size_t sent = 0;
+		for (; sent < changes.size() && byteBudget_ >= nrpnBytes_; sent++) {
+			auto nrpn = synth_->createProgramParameterNRPN(kOB6ParameterLayout[changes[sent].index].nrpn(), changes[sent].value);
+			std::copy(nrpn.begin(), nrpn.end(), std::back_inserter(messages));
+			byteBudget_ -= OB6Transport::byteCount(nrpn);
+			lastSent_[changes[sent].index] = changes[sent].value;
+		}
+		if (!messages.empty()) {
+			transport_->send(messages);
+			// The edit buffer is now somewhere between the two patches
+			synth_->invalidateEditBufferShadow();
+		}
+		statistics_.nrpnsSent += (int)sent;
+		statistics_.updatesDeferred = (int)(changes.size() - sent);
+		bool running = position < 1.0 || sent < changes.size();
+		if (!running && onlyMorphableDifferences(*from_, *to_)) {
+			// Everything else was sent with the initial dump, so the edit buffer now holds the to patch
+			synth_->setEditBufferShadow(to_);
+		}
+		return running;
+	}
+
+}
@@ -0,0 +1,63 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "OB6Patch.h"
+#include "OB6.h"
+#include "OB6Transport.h"
+
+#include <mutex>
+
+namespace midikraft {
+
+	// Morphs the OB-6's edit buffer from one program to another by streaming NRPNs. A high priority thread runs on a fixed tick,
+	// interpolates all parameters and sends those with the largest audible change first, limited to what a 5-pin DIN connection can carry.
+	// Switches and parameters with only a few steps (like the FX type) change halfway through instead of stepping through all values
+	class OB6MorphEngine : private Thread {
+	public:
+		struct Statistics {
+			int ticks;
+			int nrpnsSent;
+			int updatesDeferred; // Parameter changes postponed to a later tick because of the bandwidth limit
+			double meanJitterMilliseconds;
+			double maxJitterMilliseconds;
+		};
+
+		OB6MorphEngine(std::shared_ptr<OB6> synth, std::shared_ptr<OB6Transport> transport, int tickMilliseconds = 10);
+		virtual ~OB6MorphEngine() override;
+
+		// The morph starts by sending the from patch, so the edit buffer is in a known state. The synth's edit buffer shadow is
+		// invalidated while morphing, and set to the to patch at the end if the two differ only in morphable parameters and the name
+		void start(std::shared_ptr<OB6Patch> from, std::shared_ptr<OB6Patch> to, double durationMilliseconds);
+		void stop();
+		bool isMorphing() const;
+
+		Statistics statistics() const;
+
+	private:
+		virtual void run() override;
+		// Returns false once the morph is complete
+		bool tick(double elapsedMilliseconds);
+
+		std::shared_ptr<OB6> synth_;
+		std::shared_ptr<OB6Transport> transport_;
+		int tickMilliseconds_;
+		double bytesPerTick_;
+		int nrpnBytes_;
+
+		mutable std::mutex mutex_;
+		std::shared_ptr<OB6Patch> from_;
+		std::shared_ptr<OB6Patch> to_;
+		double durationMilliseconds_ = 0.0;
+		std::array<int, kOB6NumberOfParameters> lastSent_;
+		// Bytes we may put on the wire, refilled every tick. Starts negative while the initial edit buffer dump is still being transmitted
+		double byteBudget_ = 0.0;
+		Statistics statistics_;
+		double jitterSum_ = 0.0;
+	};
+
+}
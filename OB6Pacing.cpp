@@ -0,0 +1,148 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6Pacing.h"
+
+#include "Settings.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace midikraft {
+
+	// After this many successful programs since the last failure, the fastest failing gap is allowed to be tried again. Doubled with every failure
+	const int kOB6SuccessesBeforeRetryingFailedGap = 500;
+	const int kOB6MaxSuccessesBeforeRetryingFailedGap = 64000;
+	// Losses are counted over windows of this many programs during transfers, and each window that ends without failing tries to go a bit faster
+	const int kOB6LossWindow = 100;
+	const double kOB6TolerableLossRate = 0.1;
+
+	// At least one loss is always tolerated, so a small batch does not fail on a single random drop
+	static bool lossesTolerable(int losses, int programs) {
+		return losses <= std::max(1.0, kOB6TolerableLossRate * programs);
+	}
+
+	OB6PacingController::OB6PacingController(std::string const &portName, int safeGapMilliseconds) : portName_(portName), safeGap_(safeGapMilliseconds), gap_(safeGapMilliseconds),
+		successesBeforeRetryingFailedGap_(kOB6SuccessesBeforeRetryingFailedGap)
+	{
+	}
+
+	int OB6PacingController::gapMilliseconds() const
+	{
+		return gap_;
+	}
+
+	bool OB6PacingController::isCalibrated() const
+	{
+		return calibrated_;
+	}
+
+	int OB6PacingController::calibrate(OB6VerifiedWriter &writer, std::vector<std::shared_ptr<DataFile>> const &probePrograms, int maxRounds)
+	{
+		int good = safeGap_;
+		int bad = -1;
+		bool anyFailed = false;
+		for (int round = 0; round < maxRounds && good - bad > 1; round++) {
+			int probe = (good + bad + 1) / 2;
+			// One retry, so a random drop is told apart from a gap that is too short: only the latter loses the same program again
+			auto report = writer.write(probePrograms, probe, 1);
+			anyFailed = anyFailed || !report.failedSlots.empty();
+			if (report.failedSlots.empty() && lossesTolerable(report.retries, (int)probePrograms.size())) {
+				good = probe;
+			}
+			else {
+				bad = probe;
+			}
+		}
+		// Write the probe programs once more at a safe speed, the failed rounds might have left some slots unwritten
+		if (anyFailed) {
+			writer.write(probePrograms, good);
+		}
+		gap_ = good;
+		fastestFailingGap_ = bad;
+		calibrated_ = true;
+		successesSinceFailure_ = 0;
+		successesBeforeRetryingFailedGap_ = kOB6SuccessesBeforeRetryingFailedGap;
+		windowPrograms_ = 0;
+		windowLosses_ = 0;
+		suspectGap_ = -1;
+		save();
+		return gap_;
+	}
+
+	void OB6PacingController::reportSuccess(int programs)
+	{
+		successesSinceFailure_ += programs;
+		if (successesSinceFailure_ >= successesBeforeRetryingFailedGap_ && fastestFailingGap_ >= 0) {
+			// The failure might have been a bad phase of the interface rather than the gap, allow probing it again
+			fastestFailingGap_--;
+			successesSinceFailure_ = 0;
+		}
+		windowPrograms_ += programs;
+		if (windowPrograms_ >= kOB6LossWindow) {
+			suspectGap_ = -1;
+			// Halve the distance to the fastest failing gap, so a doubling after a random failure is undone within a few windows
+			int distance = gap_ - 1 - fastestFailingGap_;
+			if (distance > 0) {
+				gap_ -= std::max(1, distance / 2);
+			}
+			windowPrograms_ = 0;
+			windowLosses_ = 0;
+		}
+	}
+
+	void OB6PacingController::reportLoss(int programs)
+	{
+		windowPrograms_ += programs;
+		windowLosses_ += programs;
+		if (!lossesTolerable(windowLosses_, std::max(windowPrograms_, kOB6LossWindow))) {
+			gapFailed();
+		}
+	}
+
+	void OB6PacingController::gapFailed()
+	{
+		windowPrograms_ = 0;
+		windowLosses_ = 0;
+		if (suspectGap_ != gap_) {
+			// Like the retry during calibration, give the gap a second window before blaming it. Random drops rarely fail two windows in a row
+			suspectGap_ = gap_;
+			return;
+		}
+		suspectGap_ = -1;
+		fastestFailingGap_ = std::max(fastestFailingGap_, gap_);
+		gap_ = std::min(safeGap_, std::max(1, gap_ * 2));
+		successesSinceFailure_ = 0;
+		successesBeforeRetryingFailedGap_ = std::min(successesBeforeRetryingFailedGap_ * 2, kOB6MaxSuccessesBeforeRetryingFailedGap);
+		save();
+	}
+
+	void OB6PacingController::load()
+	{
+		// A gap of 0 is a valid calibration result (full speed), only a missing or unreadable entry means not calibrated
+		auto stored = Settings::instance().get(settingsKey(), "");
+		if (stored.empty()) {
+			return;
+		}
+		char *end = nullptr;
+		long gap = std::strtol(stored.c_str(), &end, 10);
+		if (*end == '\0' && gap >= 0) {
+			gap_ = (int) std::min(gap, (long) safeGap_);
+			calibrated_ = true;
+		}
+	}
+
+	void OB6PacingController::save() const
+	{
+		Settings::instance().set(settingsKey(), std::to_string(gap_));
+	}
+
+	std::string OB6PacingController::settingsKey() const
+	{
+		return "OB6PacingGap-" + portName_;
+	}
+
+}
@@ -0,0 +1,54 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "OB6VerifiedWriter.h"
+
+namespace midikraft {
+
+	// Finds the shortest pause between program dumps that a given MIDI port can sustain without the OB-6 dropping dumps. How fast is safe
+	// depends on the interface, so the learned gap is stored per port in the Settings and reused next time.
+	// Calibration bisects between a gap that lost dumps and one that did not, detecting losses by read-back. An interface can also drop a dump now and then
+	// regardless of the gap, so during calibration a gap only counts as failing when a lost program is lost again on its retry, or when more than 10 % of the
+	// programs get lost. During transfers, losses are counted per window of 100 programs, and a gap fails when two windows in a row lose more than 10 %.
+	// Such a failure doubles the gap and every window of 100 programs without too many losses goes faster again, halving the distance to
+	// the fastest gap that was seen to fail but never reaching it. That limit is lowered again after a long run of successes, so a single bad phase does not slow down the port for good.
+	// Every failure doubles the length of that run, so a gap that really is too short is retried less and less often
+	class OB6PacingController {
+	public:
+		OB6PacingController(std::string const &portName, int safeGapMilliseconds = 100);
+
+		int gapMilliseconds() const;
+		bool isCalibrated() const;
+
+		// Use a batch of programs that are going to be written anyway, calibration writes them several times
+		int calibrate(OB6VerifiedWriter &writer, std::vector<std::shared_ptr<DataFile>> const &probePrograms, int maxRounds = 8);
+
+		// Feedback from regular transfers, count every program that had to be sent again as a loss
+		void reportSuccess(int programs = 1);
+		void reportLoss(int programs = 1);
+
+		void load();
+		void save() const;
+
+	private:
+		std::string settingsKey() const;
+		void gapFailed();
+
+		std::string portName_;
+		int safeGap_;
+		int gap_;
+		int fastestFailingGap_ = -1;
+		int successesSinceFailure_ = 0;
+		int successesBeforeRetryingFailedGap_;
+		int windowPrograms_ = 0;
+		int windowLosses_ = 0;
+		int suspectGap_ = -1; // Had one window with too many losses, a second one in a row marks it as failing
+		bool calibrated_ = false;
+	};
+
+}
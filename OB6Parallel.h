@@ -0,0 +1,34 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace midikraft {
+
+	// Split [0, count) into one contiguous chunk per worker thread and wait for all of them. threads == 0 means one per core
+	inline void ob6ParallelFor(size_t count, int threads, std::function<void(size_t begin, size_t end)> const &work) {
+		size_t workers = threads > 0 ? (size_t)threads : (size_t)std::max(1u, std::thread::hardware_concurrency());
+		workers = std::max(size_t(1), std::min(workers, count));
+		if (workers <= 1) {
+			if (count > 0) work(0, count);
+			return;
+		}
+		size_t chunk = (count + workers - 1) / workers;
+		std::vector<std::thread> pool;
+		for (size_t begin = 0; begin < count; begin += chunk) {
+			pool.emplace_back(work, begin, std::min(count, begin + chunk));
+		}
+		for (auto &worker : pool) {
+			worker.join();
+		}
+	}
+
+}
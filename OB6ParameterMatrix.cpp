@@ -0,0 +1,170 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6ParameterMatrix.h"
+
+#include "OB6Parallel.h"
+#include "Patch.h"
+
+#include <algorithm>
+
+namespace midikraft {
+
+	// Compare one column against a constant, 64 patches at a time. The inner loop has no branches, so the compiler can vectorize it
+	template<typename Predicate>
+	static void scanColumn(const uint8 *column, size_t stride, OB6ParameterMatrix::Selection &result, Predicate predicate) {
+		for (size_t block = 0; block < stride / 64; block++) {
+			const uint8 *values = column + block * 64;
+			uint64 bits = 0;
+			for (size_t i = 0; i < 64; i++) {
+				bits |= uint64(predicate(values[i]) ? 1 : 0) << i;
+			}
+			result[block] = bits;
+		}
+	}
+
+	OB6ParameterMatrix::OB6ParameterMatrix() : rows_(0), stride_(0)
+	{
+	}
+
+	OB6ParameterMatrix OB6ParameterMatrix::build(std::vector<std::shared_ptr<DataFile>> const &patches, int threads)
+	{
+		OB6ParameterMatrix matrix;
+		matrix.rows_ = patches.size();
+		matrix.stride_ = (matrix.rows_ + 63) / 64 * 64;
+		matrix.storage_.resize(kOB6NumberOfParameters * matrix.stride_ / 64, CacheLine{});
+
+		// Each worker transposes whole blocks of 64 patches, so no two threads ever write into the same cache line
+		ob6ParallelFor(matrix.stride_ / 64, threads, [&matrix, &patches](size_t firstBlock, size_t lastBlock) {
+			size_t endRow = std::min(lastBlock * 64, matrix.rows_);
+			for (size_t row = firstBlock * 64; row < endRow; row++) {
+				auto const &patch = patches[row];
+				if (!patch || patch->data().size() < kOB6ProgramSize) continue;
+				const uint8 *data = patch->data().data();
+				for (size_t p = 0; p < kOB6NumberOfParameters; p++) {
+					matrix.mutableColumn(p)[row] = data[kOB6ParameterLayout[p].offset()];
+				}
+			}
+		});
+		return matrix;
+	}
+
+	size_t OB6ParameterMatrix::size() const
+	{
+		return rows_;
+	}
+
+	size_t OB6ParameterMatrix::stride() const
+	{
+		return stride_;
+	}
+
+	const uint8 * OB6ParameterMatrix::column(size_t parameterIndex) const
+	{
+		return storage_.empty() ? nullptr : storage_[parameterIndex * stride_ / 64].bytes;
+	}
+
+	const uint8 * OB6ParameterMatrix::column(OB6Parameter parameter) const
+	{
+		return column((size_t)kOB6ParameterIndexByOffset[(size_t)parameter]);
+	}
+
+	uint8 OB6ParameterMatrix::value(size_t patchIndex, OB6Parameter parameter) const
+	{
+		return column(parameter)[patchIndex];
+	}
+
+	OB6ParameterMatrix::Selection OB6ParameterMatrix::filter(OB6Parameter parameter, Comparison comparison, int value) const
+	{
+		Selection result(stride_ / 64, 0);
+		const uint8 *values = column(parameter);
+		if (!values) {
+			return result;
+		}
+		switch (comparison) {
+		case Comparison::LESS: scanColumn(values, stride_, result, [value](uint8 v) { return v < value; }); break;
+		case Comparison::LESS_EQUAL: scanColumn(values, stride_, result, [value](uint8 v) { return v <= value; }); break;
+		case Comparison::EQUAL: scanColumn(values, stride_, result, [value](uint8 v) { return v == value; }); break;
+		case Comparison::NOT_EQUAL: scanColumn(values, stride_, result, [value](uint8 v) { return v != value; }); break;
+		case Comparison::GREATER_EQUAL: scanColumn(values, stride_, result, [value](uint8 v) { return v >= value; }); break;
+		case Comparison::GREATER: scanColumn(values, stride_, result, [value](uint8 v) { return v > value; }); break;
+		}
+		clearPadding(result);
+		return result;
+	}
+
+	OB6ParameterMatrix::Selection OB6ParameterMatrix::all() const
+	{
+		Selection result(stride_ / 64, ~uint64(0));
+		clearPadding(result);
+		return result;
+	}
+
+	OB6ParameterMatrix::Selection OB6ParameterMatrix::none() const
+	{
+		return Selection(stride_ / 64, 0);
+	}
+
+	void OB6ParameterMatrix::intersect(Selection &inOut, Selection const &other)
+	{
+		for (size_t i = 0; i < inOut.size() && i < other.size(); i++) {
+			inOut[i] &= other[i];
+		}
+	}
+
+	void OB6ParameterMatrix::unite(Selection &inOut, Selection const &other)
+	{
+		for (size_t i = 0; i < inOut.size() && i < other.size(); i++) {
+			inOut[i] |= other[i];
+		}
+	}
+
+	void OB6ParameterMatrix::invert(Selection &inOut) const
+	{
+		for (auto &word : inOut) {
+			word = ~word;
+		}
+		clearPadding(inOut);
+	}
+
+	size_t OB6ParameterMatrix::count(Selection const &selection)
+	{
+		size_t result = 0;
+		for (auto word : selection) {
+			// Kernighan's way, portable across compilers
+			for (; word; word &= word - 1) result++;
+		}
+		return result;
+	}
+
+	std::vector<size_t> OB6ParameterMatrix::indices(Selection const &selection)
+	{
+		std::vector<size_t> result;
+		for (size_t block = 0; block < selection.size(); block++) {
+			for (uint64 word = selection[block]; word; word &= word - 1) {
+				size_t bit = 0;
+				while (!(word & (uint64(1) << bit))) bit++;
+				result.push_back(block * 64 + bit);
+			}
+		}
+		return result;
+	}
+
+	uint8 * OB6ParameterMatrix::mutableColumn(size_t parameterIndex)
+	{
+		return storage_[parameterIndex * stride_ / 64].bytes;
+	}
+
+	void OB6ParameterMatrix::clearPadding(Selection &selection) const
+	{
+		// The padding rows at the end of the last block never match
+		size_t used = rows_ % 64;
+		if (used != 0 && !selection.empty()) {
+			selection.back() &= (uint64(1) << used) - 1;
+		}
+	}
+
+}
@@ -0,0 +1,67 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "OB6ProgramLayout.h"
+
+namespace midikraft {
+
+	class DataFile;
+
+	// The program parameters of many OB-6 patches, stored column-wise: one contiguous array per parameter instead of one heap buffer per patch.
+	// Each column is 64 byte aligned and padded to a multiple of 64 patches, so scans over a column run on whole cache lines and vectorize well.
+	// Query results are bitsets with one bit per patch
+	class OB6ParameterMatrix {
+	public:
+		typedef std::vector<uint64> Selection;
+
+		enum class Comparison {
+			LESS,
+			LESS_EQUAL,
+			EQUAL,
+			NOT_EQUAL,
+			GREATER_EQUAL,
+			GREATER
+		};
+
+		OB6ParameterMatrix();
+
+		// Transposes the patches using the given number of threads, 0 means one per core
+		static OB6ParameterMatrix build(std::vector<std::shared_ptr<DataFile>> const &patches, int threads = 0);
+
+		size_t size() const;
+		size_t stride() const;
+		const uint8 *column(size_t parameterIndex) const;
+		const uint8 *column(OB6Parameter parameter) const;
+		uint8 value(size_t patchIndex, OB6Parameter parameter) const;
+
+		Selection filter(OB6Parameter parameter, Comparison comparison, int value) const;
+		Selection all() const;
+		Selection none() const;
+
+		static void intersect(Selection &inOut, Selection const &other);
+		static void unite(Selection &inOut, Selection const &other);
+		void invert(Selection &inOut) const;
+		static size_t count(Selection const &selection);
+		static std::vector<size_t> indices(Selection const &selection);
+
+	private:
+		struct alignas(64) CacheLine {
+			uint8 bytes[64];
+		};
+
+		uint8 *mutableColumn(size_t parameterIndex);
+		void clearPadding(Selection &selection) const;
+
+		size_t rows_;
+		size_t stride_; // rows_ rounded up to a multiple of 64
+		std::vector<CacheLine> storage_;
+	};
+
+}
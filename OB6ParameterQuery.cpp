@@ -0,0 +1,199 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6ParameterQuery.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+namespace midikraft {
+
+	static std::string lowerCaseWithoutSpaces(std::string const &input) {
+		std::string result;
+		for (auto c : input) {
+			if (!std::isspace((unsigned char)c)) {
+				result.push_back((char)std::tolower((unsigned char)c));
+			}
+		}
+		return result;
+	}
+
+	static std::vector<std::string> tokenize(std::string const &expression) {
+		std::vector<std::string> tokens;
+		size_t i = 0;
+		while (i < expression.size()) {
+			char c = expression[i];
+			if (std::isspace((unsigned char)c)) {
+				i++;
+			}
+			else if (c == '<' || c == '>' || c == '=' || c == '!') {
+				size_t length = (i + 1 < expression.size() && expression[i + 1] == '=') ? 2 : 1;
+				tokens.push_back(expression.substr(i, length));
+				i += length;
+			}
+			else {
+				size_t start = i;
+				while (i < expression.size() && !std::isspace((unsigned char)expression[i]) && std::string("<>=!").find(expression[i]) == std::string::npos) {
+					i++;
+				}
+				tokens.push_back(expression.substr(start, i - start));
+			}
+		}
+		return tokens;
+	}
+
+	static bool isComparison(std::string const &token, OB6ParameterMatrix::Comparison &comparison) {
+		if (token == "<") comparison = OB6ParameterMatrix::Comparison::LESS;
+		else if (token == "<=") comparison = OB6ParameterMatrix::Comparison::LESS_EQUAL;
+		else if (token == "=" || token == "==") comparison = OB6ParameterMatrix::Comparison::EQUAL;
+		else if (token == "!=") comparison = OB6ParameterMatrix::Comparison::NOT_EQUAL;
+		else if (token == ">=") comparison = OB6ParameterMatrix::Comparison::GREATER_EQUAL;
+		else if (token == ">") comparison = OB6ParameterMatrix::Comparison::GREATER;
+		else return false;
+		return true;
+	}
+
+	OB6ParameterQuery::OB6ParameterQuery(std::string const &expression)
+	{
+		if (!parse(tokenize(expression))) {
+			groups_.clear();
+		}
+	}
+
+	bool OB6ParameterQuery::isValid() const
+	{
+		return error_.empty();
+	}
+
+	std::string OB6ParameterQuery::errorMessage() const
+	{
+		return error_;
+	}
+
+	OB6ParameterMatrix::Selection OB6ParameterQuery::evaluate(OB6ParameterMatrix const &matrix) const
+	{
+		if (groups_.empty()) {
+			// An empty query matches everything, an invalid one nothing
+			return isValid() ? matrix.all() : matrix.none();
+		}
+		auto result = matrix.none();
+		for (auto const &group : groups_) {
+			auto groupResult = matrix.all();
+			for (auto const &clause : group) {
+				auto clauseResult = matrix.filter(clause.parameter, clause.comparison, clause.value);
+				if (clause.negate) {
+					matrix.invert(clauseResult);
+				}
+				OB6ParameterMatrix::intersect(groupResult, clauseResult);
+			}
+			OB6ParameterMatrix::unite(result, groupResult);
+		}
+		return result;
+	}
+
+	bool OB6ParameterQuery::parse(std::vector<std::string> const &tokens)
+	{
+		std::vector<Clause> group;
+		size_t i = 0;
+		while (i < tokens.size()) {
+			bool negate = false;
+			if (lowerCaseWithoutSpaces(tokens[i]) == "not") {
+				negate = true;
+				i++;
+			}
+			// The parameter name is everything up to the comparison or on/off
+			std::string name;
+			OB6ParameterMatrix::Comparison comparison = OB6ParameterMatrix::Comparison::EQUAL;
+			int value = 0;
+			bool onOff = false;
+			bool compared = false;
+			while (i < tokens.size()) {
+				auto word = lowerCaseWithoutSpaces(tokens[i]);
+				if (isComparison(tokens[i], comparison)) {
+					if (i + 1 >= tokens.size() || tokens[i + 1].find_first_not_of("0123456789") != std::string::npos) {
+						error_ = "Expected a number after " + tokens[i];
+						return false;
+					}
+					value = std::atoi(tokens[i + 1].c_str());
+					compared = true;
+					i += 2;
+					break;
+				}
+				if ((word == "and" || word == "or") && !name.empty()) {
+					// The clause ends without a comparison, reported below
+					break;
+				}
+				if ((word == "on" || word == "off") && !name.empty()) {
+					onOff = true;
+					value = word == "on" ? 1 : 0;
+					i++;
+					break;
+				}
+				name += word;
+				i++;
+			}
+			if (name.empty()) {
+				error_ = "Expected a parameter name";
+				return false;
+			}
+			if (!compared && !onOff) {
+				// Else a bare name would silently test for 0
+				error_ = "Expected a comparison after " + name;
+				return false;
+			}
+			Clause clause{ OSC1_FREQUENCY, comparison, value, negate };
+			if (!resolveParameter(name, onOff, clause.parameter)) {
+				return false;
+			}
+			group.push_back(clause);
+
+			if (i < tokens.size()) {
+				auto connective = lowerCaseWithoutSpaces(tokens[i]);
+				if (connective == "or") {
+					groups_.push_back(group);
+					group.clear();
+				}
+				else if (connective != "and") {
+					error_ = "Expected AND or OR instead of " + tokens[i];
+					return false;
+				}
+				i++;
+				if (i == tokens.size()) {
+					error_ = "Incomplete expression";
+					return false;
+				}
+			}
+		}
+		if (!group.empty()) {
+			groups_.push_back(group);
+		}
+		return true;
+	}
+
+	bool OB6ParameterQuery::resolveParameter(std::string const &name, bool onOffOnly, OB6Parameter &result)
+	{
+		std::vector<OB6Parameter> candidates;
+		for (auto const &definition : kOB6ParameterLayout) {
+			if (onOffOnly && definition.range() != 1) continue;
+			auto candidate = lowerCaseWithoutSpaces(definition.name);
+			if (candidate == name) {
+				result = definition.parameter;
+				return true;
+			}
+			if (candidate.find(name) != std::string::npos) {
+				candidates.push_back(definition.parameter);
+			}
+		}
+		if (candidates.size() == 1) {
+			result = candidates[0];
+			return true;
+		}
+		error_ = candidates.empty() ? "Unknown parameter " + name : "Ambiguous parameter " + name;
+		return false;
+	}
+
+}
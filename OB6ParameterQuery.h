@@ -0,0 +1,42 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "OB6ParameterMatrix.h"
+
+namespace midikraft {
+
+	// A small filter language over the OB-6 program parameters, e.g. "cutoff < 40 AND resonance > 100 AND arp on".
+	// Parameter names are matched case insensitively against the names in the program layout, and any unambiguous part of a name will do.
+	// Comparisons are <, <=, =, !=, >=, >. "name on" and "name off" test on/off parameters. AND binds stronger than OR, NOT negates a clause.
+	// The query is compiled once, and every evaluation is just a column scan per clause plus bitset operations, fast enough to run while typing
+	class OB6ParameterQuery {
+	public:
+		OB6ParameterQuery(std::string const &expression);
+
+		bool isValid() const;
+		std::string errorMessage() const;
+
+		OB6ParameterMatrix::Selection evaluate(OB6ParameterMatrix const &matrix) const;
+
+	private:
+		struct Clause {
+			OB6Parameter parameter;
+			OB6ParameterMatrix::Comparison comparison;
+			int value;
+			bool negate;
+		};
+
+		bool parse(std::vector<std::string> const &tokens);
+		bool resolveParameter(std::string const &name, bool onOffOnly, OB6Parameter &result);
+
+		// Disjunction of conjunctions
+		std::vector<std::vector<Clause>> groups_;
+		std::string error_;
+	};
+
+}
@@ -9,6 +9,8 @@
 
 #include <boost/format.hpp>
 
+#include <algorithm>
+
 namespace midikraft {
 
 	OB6Patch::OB6Patch(int dataTypeID, Synth::PatchData const &patchData, MidiProgramNumber programNo) : Patch(dataTypeID, patchData), place_(programNo)
@@ -19,7 +21,7 @@ namespace midikraft {
 	{
 		// The OB6 has a 20 character patch name storage
 		std::string result;
-		for (int i = 107; i < 127; i++) {
+		for (int i = kOB6ProgramNameStart; i < kOB6ProgramNameEnd; i++) {
 			result.push_back(data()[i]);
 		}
 		return result;
@@ -27,7 +29,7 @@ namespace midikraft {
 
 	void OB6Patch::setName(std::string const &name)
 	{
-		int baseIndex = 107;
+		int baseIndex = kOB6ProgramNameStart;
 		for (int i = 0; i < 20; i++) {
 			if (i < (int)name.size()) {
 				setAt(baseIndex + i, name[i]);
@@ -44,6 +46,12 @@ namespace midikraft {
 		return patchName == "Basic Program";
 	}
 
+	void OB6Patch::setParameter(OB6Parameter param, int value)
+	{
+		auto const &definition = ob6ParameterDefinition(param);
+		setAt(param, (uint8)std::max(definition.minValue, std::min(definition.maxValue, value)));
+	}
+
 	MidiProgramNumber OB6Patch::patchNumber() const
 	{
 		return place_;
@@ -9,6 +9,8 @@
 #include "Patch.h"
 #include "StoredPatchNameCapability.h"
 
+#include "OB6ProgramLayout.h"
+
 namespace midikraft {
 
 	class OB6Patch : public Patch, public StoredPatchNameCapability, public DefaultNameCapability {
@@ -23,6 +25,12 @@ namespace midikraft {
 		virtual void setName(std::string const &name) override;
 		virtual bool isDefaultName(std::string const &patchName) const override;
 
+		// Typed access to the program parameters. The parameter is its own byte offset, so reading is a single byte load
+		uint8 parameter(OB6Parameter param) const { return data()[param]; }
+		template<OB6Parameter P> uint8 get() const { return data()[P]; }
+		// Clamps to the parameter's range
+		void setParameter(OB6Parameter param, int value);
+
 	private:
 		MidiProgramNumber place_;
 	};
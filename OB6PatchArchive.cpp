@@ -0,0 +1,140 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6PatchArchive.h"
+
+#include "OB6Storage.h"
+
+namespace midikraft {
+
+	const int kOB6ArchiveMagic = 0x4f423641; // "OB6A"
+	const int kOB6ArchiveVersion = 1;
+	const size_t kOB6ArchiveHeaderSize = 64;
+	const size_t kOB6ArchiveIndexEntrySize = 16;
+	const size_t kOB6ArchivePageSize = 4096;
+
+	// All numbers in the file are little endian, as written by the JUCE output streams
+	static uint64 readLittleEndian(const uint8 *bytes, int count) {
+		uint64 result = 0;
+		for (int i = count - 1; i >= 0; i--) {
+			result = (result << 8) | bytes[i];
+		}
+		return result;
+	}
+
+	static size_t recordsOffset(size_t count) {
+		return (kOB6ArchiveHeaderSize + count * kOB6ArchiveIndexEntrySize + kOB6ArchivePageSize - 1) / kOB6ArchivePageSize * kOB6ArchivePageSize;
+	}
+
+	std::string OB6PatchArchive::Record::name() const
+	{
+		return std::string(reinterpret_cast<const char *>(data) + nameOffset, (size_t)nameLength);
+	}
+
+	bool OB6PatchArchive::write(File const &file, OB6 const &synth, std::vector<std::shared_ptr<DataFile>> const &patches)
+	{
+		std::vector<std::shared_ptr<DataFile>> programs;
+		for (auto const &patch : patches) {
+			if (patch && patch->data().size() == kOB6ProgramSize) {
+				programs.push_back(patch);
+			}
+		}
+
+		size_t offset = recordsOffset(programs.size());
+		return ob6WriteFileReplacing(file, [&](OutputStream &out) {
+			out.writeInt(kOB6ArchiveMagic);
+			out.writeInt(kOB6ArchiveVersion);
+			out.writeInt64((int64)programs.size());
+			out.writeInt((int)kOB6ProgramSize);
+			out.writeInt((int)kOB6ArchiveIndexEntrySize);
+			out.writeInt64((int64)offset);
+			std::vector<uint8> zeros(kOB6ArchivePageSize, 0);
+			out.write(zeros.data(), kOB6ArchiveHeaderSize - 32);
+
+			for (size_t i = 0; i < programs.size(); i++) {
+				auto patch = std::dynamic_pointer_cast<Patch>(programs[i]);
+				out.writeInt64((int64)synth.voiceFingerprint(programs[i]));
+				out.writeInt(patch ? patch->patchNumber().toZeroBased() : (int)i);
+				out.writeShort((short)kOB6ProgramNameStart);
+				out.writeShort((short)(kOB6ProgramNameEnd - kOB6ProgramNameStart));
+			}
+			out.write(zeros.data(), offset - kOB6ArchiveHeaderSize - programs.size() * kOB6ArchiveIndexEntrySize);
+
+			for (auto const &program : programs) {
+				out.write(program->data().data(), kOB6ProgramSize);
+			}
+		});
+	}
+
+	OB6PatchArchive::OB6PatchArchive(File const &file) : index_(nullptr), records_(nullptr), size_(0)
+	{
+		mapping_ = std::make_unique<MemoryMappedFile>(file, MemoryMappedFile::readOnly, false);
+		auto data = static_cast<const uint8 *>(mapping_->getData());
+		size_t fileSize = mapping_->getSize();
+		if (!data || fileSize < kOB6ArchiveHeaderSize
+			|| (int)readLittleEndian(data, 4) != kOB6ArchiveMagic
+			|| (int)readLittleEndian(data + 4, 4) != kOB6ArchiveVersion
+			|| readLittleEndian(data + 16, 4) != kOB6ProgramSize
+			|| readLittleEndian(data + 20, 4) != kOB6ArchiveIndexEntrySize) {
+			mapping_.reset();
+			return;
+		}
+		size_t count = (size_t)readLittleEndian(data + 8, 8);
+		size_t offset = (size_t)readLittleEndian(data + 24, 8);
+		// Don't trust the header, a truncated file must not let us read beyond the mapping
+		if (offset < kOB6ArchiveHeaderSize + count * kOB6ArchiveIndexEntrySize || offset > fileSize || (fileSize - offset) / kOB6ProgramSize < count) {
+			mapping_.reset();
+			return;
+		}
+		index_ = data + kOB6ArchiveHeaderSize;
+		records_ = data + offset;
+		size_ = count;
+	}
+
+	bool OB6PatchArchive::isValid() const
+	{
+		return mapping_ != nullptr;
+	}
+
+	size_t OB6PatchArchive::size() const
+	{
+		return size_;
+	}
+
+	OB6PatchArchive::Record OB6PatchArchive::record(size_t index) const
+	{
+		jassert(index < size_);
+		const uint8 *entry = index_ + index * kOB6ArchiveIndexEntrySize;
+		Record result;
+		result.data = records_ + index * kOB6ProgramSize;
+		result.fingerprint = readLittleEndian(entry, 8);
+		result.programNumber = (int)readLittleEndian(entry + 8, 4);
+		result.nameOffset = (int)readLittleEndian(entry + 12, 2);
+		result.nameLength = (int)readLittleEndian(entry + 14, 2);
+		if (result.nameOffset + result.nameLength > (int)kOB6ProgramSize) {
+			result.nameLength = 0;
+		}
+		return result;
+	}
+
+	std::shared_ptr<OB6Patch> OB6PatchArchive::patch(size_t index) const
+	{
+		auto view = record(index);
+		return std::make_shared<OB6Patch>(OB6::PATCH, Synth::PatchData(view.data, view.data + kOB6ProgramSize), MidiProgramNumber::fromZeroBase(view.programNumber));
+	}
+
+	int64 OB6PatchArchive::find(uint64 fingerprint) const
+	{
+		// The index is small and contiguous, a linear scan over it touches none of the records
+		for (size_t i = 0; i < size_; i++) {
+			if (readLittleEndian(index_ + i * kOB6ArchiveIndexEntrySize, 8) == fingerprint) {
+				return (int64)i;
+			}
+		}
+		return -1;
+	}
+
+}
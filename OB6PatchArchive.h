@@ -0,0 +1,52 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "OB6.h"
+#include "OB6Patch.h"
+
+namespace midikraft {
+
+	// A native archive of unpacked OB-6 programs that needs no sysex parsing to open. The file is a 64 byte header, an index with one
+	// 16 byte entry per program (fingerprint, program number, name position) and then the programs as page aligned 1024 byte records.
+	// The archive is memory mapped read-only, so opening it costs nothing regardless of its size, and several processes share the page cache
+	class OB6PatchArchive {
+	public:
+		// A program inside the mapping, valid as long as the archive is open
+		struct Record {
+			const uint8 *data;
+			uint64 fingerprint;
+			int programNumber;
+			int nameOffset;
+			int nameLength;
+
+			uint8 parameter(OB6Parameter param) const { return data[param]; }
+			std::string name() const;
+		};
+
+		// Replaces the file only once the new archive is completely written, processes that have the old one mapped keep their view
+		static bool write(File const &file, OB6 const &synth, std::vector<std::shared_ptr<DataFile>> const &patches);
+
+		OB6PatchArchive(File const &file);
+
+		bool isValid() const;
+		size_t size() const;
+
+		Record record(size_t index) const;
+		// Copies the 1024 bytes of the record into a new patch
+		std::shared_ptr<OB6Patch> patch(size_t index) const;
+		// Index of the first program with the fingerprint, or -1
+		int64 find(uint64 fingerprint) const;
+
+	private:
+		std::unique_ptr<MemoryMappedFile> mapping_;
+		const uint8 *index_;
+		const uint8 *records_;
+		size_t size_;
+	};
+
+}
@@ -0,0 +1,142 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6PatchCategorizer.h"
+
+#include "OB6Parallel.h"
+
+namespace midikraft {
+
+	// Rules of thumb for the OB-6 factory and user banks. Envelope times, cutoff and resonance run from 0 to 254,
+	// oscillator frequencies count semitones from C0
+	struct DefaultRule {
+		OB6PatchCategorizer::Category category;
+		const char *expression;
+	};
+
+	static const DefaultRule kDefaultRules[] = {
+		{ OB6PatchCategorizer::BASS, "osc 1 frequency <= 24 AND osc 2 frequency <= 30 AND cutoff < 100 AND amp env attack < 20" },
+		{ OB6PatchCategorizer::BASS, "sub octave level > 60 AND osc 1 frequency <= 30 AND cutoff < 100 AND amp env attack < 20" },
+		{ OB6PatchCategorizer::PAD, "amp env attack > 60 AND amp env sustain > 100 AND amp env release > 80" },
+		{ OB6PatchCategorizer::PAD, "filter env attack > 100 AND amp env sustain > 100 AND amp env release > 100" },
+		{ OB6PatchCategorizer::LEAD, "unison on AND amp env attack < 40 AND amp env sustain > 80" },
+		{ OB6PatchCategorizer::LEAD, "glide on AND amp env attack < 40 AND osc 1 frequency >= 24" },
+		{ OB6PatchCategorizer::BRASS, "filter env attack >= 10 AND filter env attack < 80 AND filter env amount > 160 AND amp env sustain > 120 AND resonance < 120" },
+		{ OB6PatchCategorizer::PLUCK, "amp env attack < 10 AND amp env sustain < 60 AND amp env decay >= 30 AND amp env decay < 150" },
+		{ OB6PatchCategorizer::PLUCK, "filter env attack < 10 AND filter env sustain < 40 AND filter env decay < 120 AND filter env amount > 150 AND amp env attack < 10" },
+		{ OB6PatchCategorizer::PERCUSSIVE, "amp env attack < 5 AND amp env sustain < 10 AND amp env decay < 30" },
+		{ OB6PatchCategorizer::PERCUSSIVE, "noise level > 80 AND amp env attack < 10 AND amp env sustain < 30" },
+		{ OB6PatchCategorizer::ARP, "arp on" },
+		{ OB6PatchCategorizer::SFX, "x-mod osc 2 > 120 AND x-mod to osc 1 freq on" },
+		{ OB6PatchCategorizer::SFX, "lfo amount > 180 AND lfo to osc 1 freq on AND lfo to osc 2 freq on" },
+		{ OB6PatchCategorizer::SFX, "noise level > 100 AND osc 1 level < 20 AND osc 2 level < 20" },
+	};
+
+	OB6PatchCategorizer::OB6PatchCategorizer(std::shared_ptr<OB6> synth) : synth_(synth)
+	{
+		for (auto const &rule : kDefaultRules) {
+			bool valid = addRule(rule.category, rule.expression);
+			ignoreUnused(valid);
+			jassert(valid);
+		}
+	}
+
+	std::string OB6PatchCategorizer::categoryName(Category category)
+	{
+		switch (category) {
+		case BASS: return "Bass";
+		case PAD: return "Pad";
+		case LEAD: return "Lead";
+		case BRASS: return "Brass";
+		case PLUCK: return "Pluck";
+		case PERCUSSIVE: return "Percussive";
+		case ARP: return "Arp";
+		case SFX: return "SFX";
+		default: return "Unknown";
+		}
+	}
+
+	bool OB6PatchCategorizer::hasCategory(Categories categories, Category category)
+	{
+		return (categories & (1u << category)) != 0;
+	}
+
+	bool OB6PatchCategorizer::addRule(Category category, std::string const &expression)
+	{
+		OB6ParameterQuery query(expression);
+		if (!query.isValid() || expression.empty()) {
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(mutex_);
+		rules_.push_back({ category, query });
+		// Cached results were made without the new rule
+		cache_.clear();
+		return true;
+	}
+
+	std::vector<OB6PatchCategorizer::Categories> OB6PatchCategorizer::categorize(std::vector<std::shared_ptr<DataFile>> const &patches, int threads)
+	{
+		std::vector<uint64> fingerprints(patches.size(), 0);
+		ob6ParallelFor(patches.size(), threads, [this, &patches, &fingerprints](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				if (patches[i]) {
+					fingerprints[i] = synth_->voiceFingerprint(patches[i]);
+				}
+			}
+		});
+
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		// Only patches not seen before go into the matrix, and each of them only once
+		std::vector<std::shared_ptr<DataFile>> unknown;
+		std::map<uint64, size_t> unknownIndex;
+		for (size_t i = 0; i < patches.size(); i++) {
+			if (fingerprints[i] != 0 && cache_.find(fingerprints[i]) == cache_.end() && unknownIndex.find(fingerprints[i]) == unknownIndex.end()) {
+				unknownIndex[fingerprints[i]] = unknown.size();
+				unknown.push_back(patches[i]);
+			}
+		}
+
+		if (!unknown.empty()) {
+			auto matrix = OB6ParameterMatrix::build(unknown, threads);
+			std::vector<Categories> found(unknown.size(), 0);
+			for (auto const &rule : rules_) {
+				for (size_t row : OB6ParameterMatrix::indices(rule.query.evaluate(matrix))) {
+					found[row] |= 1u << rule.category;
+				}
+			}
+			for (auto const &entry : unknownIndex) {
+				cache_[entry.first] = found[entry.second];
+			}
+		}
+
+		std::vector<Categories> result(patches.size(), 0);
+		for (size_t i = 0; i < patches.size(); i++) {
+			if (fingerprints[i] != 0) {
+				result[i] = cache_[fingerprints[i]];
+			}
+		}
+		return result;
+	}
+
+	OB6PatchCategorizer::Categories OB6PatchCategorizer::categorize(std::shared_ptr<DataFile> patch)
+	{
+		return categorize(std::vector<std::shared_ptr<DataFile>>({ patch }), 1)[0];
+	}
+
+	size_t OB6PatchCategorizer::cacheSize() const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return cache_.size();
+	}
+
+	void OB6PatchCategorizer::clearCache()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		cache_.clear();
+	}
+
+}
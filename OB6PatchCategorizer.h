@@ -0,0 +1,61 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "OB6.h"
+#include "OB6ParameterQuery.h"
+
+#include <map>
+#include <mutex>
+
+namespace midikraft {
+
+	// Guesses categories for OB-6 programs from their parameters, e.g. long attack and release make a pad.
+	// The rules are parameter queries, so a whole library is categorized with a few column scans over an OB6ParameterMatrix.
+	// Results are cached by voice fingerprint, importing patches that have been seen before costs only the fingerprint
+	class OB6PatchCategorizer {
+	public:
+		enum Category {
+			BASS,
+			PAD,
+			LEAD,
+			BRASS,
+			PLUCK,
+			PERCUSSIVE,
+			ARP,
+			SFX,
+			NUMBER_OF_CATEGORIES
+		};
+		typedef uint32 Categories; // One bit per Category
+
+		OB6PatchCategorizer(std::shared_ptr<OB6> synth);
+
+		static std::string categoryName(Category category);
+		static bool hasCategory(Categories categories, Category category);
+
+		// A patch gets the category if any of its rules match. Returns false and ignores the rule if the expression does not parse
+		bool addRule(Category category, std::string const &expression);
+
+		std::vector<Categories> categorize(std::vector<std::shared_ptr<DataFile>> const &patches, int threads = 0);
+		Categories categorize(std::shared_ptr<DataFile> patch);
+
+		size_t cacheSize() const;
+		void clearCache();
+
+	private:
+		struct Rule {
+			Category category;
+			OB6ParameterQuery query;
+		};
+
+		std::shared_ptr<OB6> synth_;
+		std::vector<Rule> rules_;
+		mutable std::mutex mutex_;
+		std::map<uint64, Categories> cache_;
+	};
+
+}
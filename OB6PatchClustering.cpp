@@ -0,0 +1,210 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6PatchClustering.h"
+
+#include "OB6Parallel.h"
+
+#include <limits>
+#include <random>
+
+namespace midikraft {
+
+	// Number of points per work unit. Each block keeps its own partial sums, which are added up in block order afterwards
+	static const size_t kBlockSize = 4096;
+
+	// The draws come from the raw generator output, because the std distributions differ between standard libraries and a seed should cluster the same everywhere
+	static double unitInterval(std::mt19937_64 &random) {
+		return (random() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	static size_t uniformIndex(std::mt19937_64 &random, size_t count) {
+		// The modulo bias is below 1e-13 for any library size
+		return (size_t)(random() % (uint64)count);
+	}
+
+	// Eight independent accumulators, so the compiler can keep them in one vector register without reordering float additions
+	static inline float squaredDistance(const float *a, const float *b, size_t dimensions) {
+		float lanes[8] = { 0 };
+		for (size_t i = 0; i < dimensions; i += 8) {
+			for (size_t j = 0; j < 8; j++) {
+				float d = a[i + j] - b[i + j];
+				lanes[j] += d * d;
+			}
+		}
+		return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+	}
+
+	static inline int nearestCentroid(const float *point, std::vector<float> const &centroids, size_t clusters, size_t dimensions, float &distance) {
+		int best = 0;
+		distance = std::numeric_limits<float>::max();
+		for (size_t c = 0; c < clusters; c++) {
+			float d = squaredDistance(point, centroids.data() + c * dimensions, dimensions);
+			if (d < distance) {
+				distance = d;
+				best = (int)c;
+			}
+		}
+		return best;
+	}
+
+	std::vector<float> OB6PatchClustering::features(OB6ParameterMatrix const &matrix, size_t &dimensions, int threads)
+	{
+		dimensions = (kOB6NumberOfParameters + 7) / 8 * 8;
+		std::vector<float> result(matrix.size() * dimensions, 0.0f);
+		ob6ParallelFor(matrix.size(), threads, [&](size_t begin, size_t end) {
+			for (size_t p = 0; p < kOB6NumberOfParameters; p++) {
+				auto const &definition = kOB6ParameterLayout[p];
+				float scale = definition.range() > 0 ? 1.0f / definition.range() : 0.0f;
+				const uint8 *column = matrix.column(p);
+				for (size_t row = begin; row < end; row++) {
+					float value = (column[row] - definition.minValue) * scale;
+					result[row * dimensions + p] = std::min(1.0f, std::max(0.0f, value));
+				}
+			}
+		});
+		return result;
+	}
+
+	OB6PatchClustering::Result OB6PatchClustering::cluster(OB6ParameterMatrix const &matrix, Options const &options)
+	{
+		Result result;
+		size_t rows = matrix.size();
+		size_t clusters = (size_t)std::max(1, std::min(options.clusters, (int)rows));
+		if (rows == 0) {
+			return result;
+		}
+		size_t dimensions;
+		std::vector<float> points = features(matrix, dimensions, options.threads);
+		result.dimensions = dimensions;
+		size_t blocks = (rows + kBlockSize - 1) / kBlockSize;
+
+		// k-means++ seeding: every further centroid is drawn with probability proportional to the squared distance to the nearest one so far
+		std::mt19937_64 random(options.seed);
+		std::vector<float> centroids(clusters * dimensions);
+		std::vector<float> closest(rows, std::numeric_limits<float>::max());
+		std::vector<double> blockWeight(blocks);
+		size_t chosen = uniformIndex(random, rows);
+		for (size_t c = 0; c < clusters; c++) {
+			std::copy_n(points.begin() + chosen * dimensions, dimensions, centroids.begin() + c * dimensions);
+			if (c + 1 == clusters) break;
+			const float *centroid = centroids.data() + c * dimensions;
+			ob6ParallelFor(blocks, options.threads, [&](size_t firstBlock, size_t lastBlock) {
+				for (size_t block = firstBlock; block < lastBlock; block++) {
+					double sum = 0.0;
+					for (size_t row = block * kBlockSize; row < std::min(rows, (block + 1) * kBlockSize); row++) {
+						closest[row] = std::min(closest[row], squaredDistance(points.data() + row * dimensions, centroid, dimensions));
+						sum += closest[row];
+					}
+					blockWeight[block] = sum;
+				}
+			});
+			double total = 0.0;
+			for (double weight : blockWeight) total += weight;
+			if (total <= 0.0) {
+				// Fewer distinct patches than clusters, duplicates do no harm
+				chosen = uniformIndex(random, rows);
+				continue;
+			}
+			double target = unitInterval(random) * total;
+			size_t block = 0;
+			while (block + 1 < blocks && target >= blockWeight[block]) {
+				target -= blockWeight[block++];
+			}
+			chosen = std::min(rows, (block + 1) * kBlockSize) - 1;
+			for (size_t row = block * kBlockSize; row < std::min(rows, (block + 1) * kBlockSize); row++) {
+				if (target < closest[row]) {
+					chosen = row;
+					break;
+				}
+				target -= closest[row];
+			}
+		}
+
+		// Lloyd iterations. The assignment step runs in parallel, each block sums up its members per cluster
+		result.assignment.assign(rows, -1);
+		std::vector<double> blockSums(blocks * clusters * dimensions);
+		std::vector<size_t> blockCounts(blocks * clusters);
+		std::vector<size_t> blockChanges(blocks);
+		std::vector<double> blockInertia(blocks);
+		int maxIterations = std::max(1, options.maxIterations);
+		while (true) {
+			result.iterations++;
+			std::fill(blockSums.begin(), blockSums.end(), 0.0);
+			std::fill(blockCounts.begin(), blockCounts.end(), 0);
+			ob6ParallelFor(blocks, options.threads, [&](size_t firstBlock, size_t lastBlock) {
+				for (size_t block = firstBlock; block < lastBlock; block++) {
+					double *sums = blockSums.data() + block * clusters * dimensions;
+					size_t *counts = blockCounts.data() + block * clusters;
+					size_t changes = 0;
+					double inertia = 0.0;
+					for (size_t row = block * kBlockSize; row < std::min(rows, (block + 1) * kBlockSize); row++) {
+						const float *point = points.data() + row * dimensions;
+						float distance;
+						int nearest = nearestCentroid(point, centroids, clusters, dimensions, distance);
+						if (nearest != result.assignment[row]) {
+							result.assignment[row] = nearest;
+							changes++;
+						}
+						inertia += distance;
+						counts[nearest]++;
+						double *sum = sums + nearest * dimensions;
+						for (size_t d = 0; d < dimensions; d++) {
+							sum[d] += point[d];
+						}
+					}
+					blockChanges[block] = changes;
+					blockInertia[block] = inertia;
+				}
+			});
+
+			size_t changes = 0;
+			result.inertia = 0.0;
+			for (size_t block = 0; block < blocks; block++) {
+				changes += blockChanges[block];
+				result.inertia += blockInertia[block];
+			}
+			// Without an update after the last assignment pass, assignment, inertia and representatives belong to the returned centroids
+			if (changes == 0 || result.iterations == maxIterations) {
+				break;
+			}
+
+			// Update step, an empty cluster keeps its previous centroid
+			for (size_t c = 0; c < clusters; c++) {
+				size_t members = 0;
+				std::vector<double> sum(dimensions, 0.0);
+				for (size_t block = 0; block < blocks; block++) {
+					members += blockCounts[block * clusters + c];
+					const double *partial = blockSums.data() + (block * clusters + c) * dimensions;
+					for (size_t d = 0; d < dimensions; d++) {
+						sum[d] += partial[d];
+					}
+				}
+				if (members > 0) {
+					for (size_t d = 0; d < dimensions; d++) {
+						centroids[c * dimensions + d] = (float)(sum[d] / members);
+					}
+				}
+			}
+		}
+
+		result.centroids = centroids;
+		result.clusterSizes.assign(clusters, 0);
+		result.representatives.assign(clusters, 0);
+		std::vector<float> bestDistance(clusters, std::numeric_limits<float>::max());
+		for (size_t row = 0; row < rows; row++) {
+			size_t c = (size_t)result.assignment[row];
+			result.clusterSizes[c]++;
+			float distance = squaredDistance(points.data() + row * dimensions, centroids.data() + c * dimensions, dimensions);
+			if (distance < bestDistance[c]) {
+				bestDistance[c] = distance;
+				result.representatives[c] = row;
+			}
+		}
+		return result;
+	}
+
+}
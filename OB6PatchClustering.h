@@ -0,0 +1,43 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "OB6ParameterMatrix.h"
+
+namespace midikraft {
+
+	// Groups the patches of an OB6ParameterMatrix into sound families with k-means over their program parameters.
+	// Every parameter is normalized to 0..1 by its range, so a switch weighs as much as a full sweep of the cutoff.
+	// Points are processed in fixed blocks that are merged in order, so the result for a given seed does not depend on the number of threads or the standard library
+	class OB6PatchClustering {
+	public:
+		struct Options {
+			int clusters = 16;
+			int maxIterations = 50; // Assignment passes. If not converged by then, the centroids of the last pass are returned
+			uint64 seed = 0;
+			int threads = 0; // 0 means one per core
+		};
+
+		struct Result {
+			size_t dimensions = 0; // Row length of centroids, a multiple of 8
+			std::vector<int> assignment; // Cluster of each patch
+			std::vector<float> centroids; // clusters x dimensions, normalized parameter values
+			std::vector<size_t> clusterSizes;
+			std::vector<size_t> representatives; // Index of the patch closest to each centroid
+			int iterations = 0;
+			double inertia = 0.0; // Sum of squared distances of all patches to their centroid
+		};
+
+		static Result cluster(OB6ParameterMatrix const &matrix, Options const &options);
+
+		// Row-major normalized parameter vectors, padded with zeros to dimensions floats per patch
+		static std::vector<float> features(OB6ParameterMatrix const &matrix, size_t &dimensions, int threads = 0);
+	};
+
+}
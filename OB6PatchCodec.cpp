@@ -0,0 +1,428 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6PatchCodec.h"
+
+#include "OB6Storage.h"
+
+#include <algorithm>
+#include <queue>
+
+namespace midikraft {
+
+	const int kOB6LibraryMagic = 0x4f42365a; // "OB6Z"
+	const int kOB6LibraryVersion = 2;
+
+	static void writeVarint(size_t value, std::vector<uint8> &out) {
+		while (value >= 0x80) {
+			out.push_back((uint8)(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back((uint8)value);
+	}
+
+	// The run encoded bytes, straight from memory
+	class OB6RawSource {
+	public:
+		OB6RawSource(const uint8 *data, size_t size) : read_(data), end_(data + size) {}
+
+		bool next(uint8 &byte) {
+			if (read_ == end_) return false;
+			byte = *read_++;
+			return true;
+		}
+		bool atEnd() const { return read_ == end_; }
+
+	private:
+		const uint8 *read_;
+		const uint8 *end_;
+	};
+
+	template<typename Source>
+	static bool readVarint(Source &source, size_t &value) {
+		value = 0;
+		for (int shift = 0; shift < 32; shift += 7) {
+			uint8 byte;
+			if (!source.next(byte)) {
+				return false;
+			}
+			value |= size_t(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Undo the run encoding, the source delivers the bytes either directly or out of the Huffman stage
+	template<typename Source>
+	static bool decodeRuns(const uint8 *reference, Source &source, uint8 *program) {
+		size_t i = 0;
+		while (i < kOB6ProgramSize) {
+			size_t zeros, literals;
+			if (!readVarint(source, zeros) || !readVarint(source, literals) || zeros + literals > kOB6ProgramSize - i) {
+				return false;
+			}
+			std::copy_n(reference + i, zeros, program + i);
+			i += zeros;
+			for (size_t j = 0; j < literals; j++, i++) {
+				uint8 byte;
+				if (!source.next(byte)) {
+					return false;
+				}
+				program[i] = byte ^ reference[i];
+			}
+		}
+		return source.atEnd();
+	}
+
+	OB6PatchCodec::OB6PatchCodec(Synth::PatchData const &reference) : reference_(reference)
+	{
+		jassert(reference_.size() == kOB6ProgramSize);
+		reference_.resize(kOB6ProgramSize, 0);
+	}
+
+	OB6PatchCodec OB6PatchCodec::train(std::vector<std::shared_ptr<DataFile>> const &patches)
+	{
+		// One histogram per byte offset
+		std::vector<std::array<uint32, 256>> histogram(kOB6ProgramSize);
+		for (auto &counts : histogram) counts.fill(0);
+		for (auto const &patch : patches) {
+			if (patch && patch->data().size() == kOB6ProgramSize) {
+				const uint8 *data = patch->data().data();
+				for (size_t i = 0; i < kOB6ProgramSize; i++) {
+					histogram[i][data[i]]++;
+				}
+			}
+		}
+		Synth::PatchData reference(kOB6ProgramSize, 0);
+		for (size_t i = 0; i < kOB6ProgramSize; i++) {
+			reference[i] = (uint8)(std::max_element(histogram[i].begin(), histogram[i].end()) - histogram[i].begin());
+		}
+		return OB6PatchCodec(reference);
+	}
+
+	Synth::PatchData const & OB6PatchCodec::reference() const
+	{
+		return reference_;
+	}
+
+	void OB6PatchCodec::encode(const uint8 *program, std::vector<uint8> &out) const
+	{
+		const uint8 *reference = reference_.data();
+		size_t i = 0;
+		while (i < kOB6ProgramSize) {
+			size_t zeros = 0;
+			while (i + zeros < kOB6ProgramSize && program[i + zeros] == reference[i + zeros]) zeros++;
+			i += zeros;
+			// A single matching byte between differences is cheaper as literal than as a new run
+			size_t literals = 0;
+			while (i + literals < kOB6ProgramSize && (program[i + literals] != reference[i + literals]
+				|| (i + literals + 1 < kOB6ProgramSize && program[i + literals + 1] != reference[i + literals + 1]))) {
+				literals++;
+			}
+			writeVarint(zeros, out);
+			writeVarint(literals, out);
+			for (size_t j = 0; j < literals; j++) {
+				out.push_back(program[i + j] ^ reference[i + j]);
+			}
+			i += literals;
+		}
+	}
+
+	bool OB6PatchCodec::decode(const uint8 *encoded, size_t size, uint8 *program) const
+	{
+		OB6RawSource source(encoded, size);
+		return decodeRuns(reference_.data(), source, program);
+	}
+
+	OB6HuffmanCode::OB6HuffmanCode()
+	{
+		lengths_.fill(0);
+		codes_.fill(0);
+	}
+
+	OB6HuffmanCode OB6HuffmanCode::train(std::array<uint64, 256> const &frequencies)
+	{
+		std::array<uint64, 256> weights = frequencies;
+		while (true) {
+			// Classic Huffman construction, the depth of each leaf is its code length
+			struct Node {
+				uint64 weight;
+				int left, right;
+			};
+			std::vector<Node> nodes;
+			auto heavier = [&nodes](int a, int b) { return nodes[(size_t)a].weight > nodes[(size_t)b].weight || (nodes[(size_t)a].weight == nodes[(size_t)b].weight && a > b); };
+			std::priority_queue<int, std::vector<int>, decltype(heavier)> queue(heavier);
+			for (int symbol = 0; symbol < 256; symbol++) {
+				nodes.push_back({ weights[(size_t)symbol], -1, -1 });
+				if (weights[(size_t)symbol] > 0) {
+					queue.push(symbol);
+				}
+			}
+			std::array<uint8, 256> lengths;
+			lengths.fill(0);
+			if (queue.empty()) {
+				return OB6HuffmanCode();
+			}
+			if (queue.size() == 1) {
+				lengths[(size_t)queue.top()] = 1;
+				return fromCodeLengths(lengths);
+			}
+			while (queue.size() > 1) {
+				int a = queue.top(); queue.pop();
+				int b = queue.top(); queue.pop();
+				nodes.push_back({ nodes[(size_t)a].weight + nodes[(size_t)b].weight, a, b });
+				queue.push((int)nodes.size() - 1);
+			}
+			int maxLength = 0;
+			std::vector<std::pair<int, int>> stack({ { queue.top(), 0 } });
+			while (!stack.empty()) {
+				auto entry = stack.back();
+				stack.pop_back();
+				auto const &node = nodes[(size_t)entry.first];
+				if (node.left < 0) {
+					lengths[(size_t)entry.first] = (uint8)std::min(entry.second, 255);
+					maxLength = std::max(maxLength, entry.second);
+				}
+				else {
+					stack.push_back({ node.left, entry.second + 1 });
+					stack.push_back({ node.right, entry.second + 1 });
+				}
+			}
+			if (maxLength <= kMaxCodeLength) {
+				return fromCodeLengths(lengths);
+			}
+			// Too deep for the lookup table. Flatten the distribution and try again, rare symbols just get slightly longer codes
+			for (auto &weight : weights) {
+				if (weight > 0) weight = std::max(uint64(1), weight / 2);
+			}
+		}
+	}
+
+	OB6HuffmanCode OB6HuffmanCode::fromCodeLengths(std::array<uint8, 256> const &lengths)
+	{
+		OB6HuffmanCode result;
+		uint32 kraft = 0;
+		for (auto length : lengths) {
+			if (length > kMaxCodeLength) {
+				return OB6HuffmanCode();
+			}
+			if (length > 0) {
+				kraft += 1u << (kMaxCodeLength - length);
+			}
+		}
+		if (kraft == 0 || kraft > (1u << kMaxCodeLength)) {
+			return OB6HuffmanCode();
+		}
+
+		// Canonical codes: ordered by length, then by symbol
+		result.lengths_ = lengths;
+		result.table_.assign(size_t(1) << kMaxCodeLength, 0);
+		uint32 code = 0;
+		for (int length = 1; length <= kMaxCodeLength; length++) {
+			for (size_t symbol = 0; symbol < 256; symbol++) {
+				if (lengths[symbol] == length) {
+					result.codes_[symbol] = (uint16)code;
+					uint32 first = code << (kMaxCodeLength - length);
+					std::fill_n(result.table_.begin() + first, size_t(1) << (kMaxCodeLength - length), (uint16)(symbol << 4 | (size_t)length));
+					code++;
+				}
+			}
+			code <<= 1;
+		}
+		return result;
+	}
+
+	bool OB6HuffmanCode::isValid() const
+	{
+		return !table_.empty();
+	}
+
+	std::array<uint8, 256> const & OB6HuffmanCode::codeLengths() const
+	{
+		return lengths_;
+	}
+
+	void OB6HuffmanCode::encode(std::vector<uint8> const &bytes, std::vector<uint8> &out) const
+	{
+		uint64 pending = 0;
+		int pendingBits = 0;
+		for (auto byte : bytes) {
+			jassert(lengths_[byte] > 0);
+			pending = (pending << lengths_[byte]) | codes_[byte];
+			pendingBits += lengths_[byte];
+			while (pendingBits >= 8) {
+				out.push_back((uint8)(pending >> (pendingBits - 8)));
+				pendingBits -= 8;
+			}
+		}
+		if (pendingBits > 0) {
+			out.push_back((uint8)(pending << (8 - pendingBits)));
+		}
+	}
+
+	OB6HuffmanCode::Reader::Reader(OB6HuffmanCode const &code, const uint8 *data, size_t size) : code_(code), read_(data), end_(data + size), bits_(0), bitCount_(0)
+	{
+	}
+
+	void OB6HuffmanCode::Reader::refill()
+	{
+		while (bitCount_ <= 56 && read_ < end_) {
+			bits_ |= uint64(*read_++) << (56 - bitCount_);
+			bitCount_ += 8;
+		}
+	}
+
+	bool OB6HuffmanCode::Reader::next(uint8 &symbol)
+	{
+		if (bitCount_ < kMaxCodeLength) {
+			refill();
+		}
+		// Beyond the end the buffer holds zeros, the length check below catches codes that would need them
+		uint16 entry = code_.table_[(size_t)(bits_ >> (64 - kMaxCodeLength))];
+		int length = entry & 0x0f;
+		if (length == 0 || length > bitCount_) {
+			return false;
+		}
+		symbol = (uint8)(entry >> 4);
+		bits_ <<= length;
+		bitCount_ -= length;
+		return true;
+	}
+
+	bool OB6HuffmanCode::Reader::atEnd() const
+	{
+		return read_ == end_ && bitCount_ < 8;
+	}
+
+	OB6CompressedLibrary::OB6CompressedLibrary(OB6PatchCodec const &codec, OB6HuffmanCode const &code) : codec_(codec), code_(code)
+	{
+		offsets_.push_back(0);
+	}
+
+	OB6CompressedLibrary OB6CompressedLibrary::build(OB6PatchCodec const &codec, std::vector<std::shared_ptr<DataFile>> const &patches)
+	{
+		// First pass run encodes all programs and counts the bytes, the Huffman code is trained on exactly what it will encode
+		std::vector<std::vector<uint8>> runs;
+		std::array<uint64, 256> frequencies;
+		frequencies.fill(0);
+		for (auto const &patch : patches) {
+			if (patch && patch->data().size() == kOB6ProgramSize) {
+				runs.emplace_back();
+				codec.encode(patch->data().data(), runs.back());
+				for (auto byte : runs.back()) {
+					frequencies[byte]++;
+				}
+			}
+		}
+
+		OB6CompressedLibrary library(codec, OB6HuffmanCode::train(frequencies));
+		for (auto const &run : runs) {
+			library.code_.encode(run, library.data_);
+			library.offsets_.push_back((uint32)library.data_.size());
+			library.runEncodedBytes_ += run.size();
+		}
+		return library;
+	}
+
+	size_t OB6CompressedLibrary::size() const
+	{
+		return offsets_.size() - 1;
+	}
+
+	bool OB6CompressedLibrary::decode(size_t index, uint8 *program) const
+	{
+		OB6HuffmanCode::Reader reader(code_, data_.data() + offsets_[index], offsets_[index + 1] - offsets_[index]);
+		return decodeRuns(codec_.reference().data(), reader, program);
+	}
+
+	bool OB6CompressedLibrary::program(size_t index, Synth::PatchData &result) const
+	{
+		if (index >= size()) {
+			return false;
+		}
+		result.resize(kOB6ProgramSize);
+		return decode(index, result.data());
+	}
+
+	bool OB6CompressedLibrary::save(File const &file) const
+	{
+		return ob6WriteFileReplacing(file, [this](OutputStream &out) {
+			out.writeInt(kOB6LibraryMagic);
+			out.writeInt(kOB6LibraryVersion);
+			out.write(codec_.reference().data(), kOB6ProgramSize);
+			out.write(code_.codeLengths().data(), code_.codeLengths().size());
+			out.writeInt((int)size());
+			out.writeInt64((int64)runEncodedBytes_);
+			for (auto offset : offsets_) {
+				out.writeInt((int)offset);
+			}
+			out.write(data_.data(), data_.size());
+		});
+	}
+
+	std::shared_ptr<OB6CompressedLibrary> OB6CompressedLibrary::load(File const &file)
+	{
+		FileInputStream in(file);
+		if (!in.openedOk() || in.readInt() != kOB6LibraryMagic || in.readInt() != kOB6LibraryVersion) {
+			return nullptr;
+		}
+		Synth::PatchData reference(kOB6ProgramSize);
+		std::array<uint8, 256> lengths;
+		if (in.read(reference.data(), (int)kOB6ProgramSize) != (int)kOB6ProgramSize || in.read(lengths.data(), (int)lengths.size()) != (int)lengths.size()) {
+			return nullptr;
+		}
+		// Don't trust the counts in the file, check them against its length before allocating anything
+		int count = in.readInt();
+		int64 runEncodedBytes = in.readInt64();
+		int64 remaining = in.getTotalLength() - in.getPosition();
+		if (count < 0 || (int64(count) + 1) * 4 > remaining) {
+			return nullptr;
+		}
+		auto code = OB6HuffmanCode::fromCodeLengths(lengths);
+		if (count > 0 && !code.isValid()) {
+			return nullptr;
+		}
+		auto library = std::shared_ptr<OB6CompressedLibrary>(new OB6CompressedLibrary(OB6PatchCodec(reference), code));
+		library->runEncodedBytes_ = (size_t)std::max(int64(0), runEncodedBytes);
+		library->offsets_.resize((size_t)count + 1);
+		for (auto &offset : library->offsets_) {
+			offset = (uint32)in.readInt();
+		}
+		remaining -= (int64(count) + 1) * 4;
+		if (library->offsets_.front() != 0 || int64(library->offsets_.back()) != remaining || !std::is_sorted(library->offsets_.begin(), library->offsets_.end())) {
+			return nullptr;
+		}
+		library->data_.resize(library->offsets_.back());
+		if (in.read(library->data_.data(), (int)library->data_.size()) != (int)library->data_.size()) {
+			return nullptr;
+		}
+		return library;
+	}
+
+	OB6CompressedLibrary::Statistics OB6CompressedLibrary::measure() const
+	{
+		Statistics result;
+		result.programs = size();
+		result.rawBytes = size() * kOB6ProgramSize;
+		result.runEncodedBytes = runEncodedBytes_;
+		result.compressedBytes = kOB6ProgramSize + code_.codeLengths().size() + offsets_.size() * sizeof(uint32) + data_.size();
+		result.compressionRatio = result.compressedBytes > 0 ? result.rawBytes / (double)result.compressedBytes : 0.0;
+
+		std::vector<uint8> decoded(kOB6ProgramSize);
+		double start = Time::getMillisecondCounterHiRes();
+		for (size_t i = 0; i < size(); i++) {
+			decode(i, decoded.data());
+		}
+		double seconds = (Time::getMillisecondCounterHiRes() - start) / 1000.0;
+		if (seconds > 0.0) {
+			result.decodeMegabytesPerSecond = result.rawBytes / (1024.0 * 1024.0) / seconds;
+		}
+		return result;
+	}
+
+}
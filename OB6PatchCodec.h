@@ -0,0 +1,119 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "Patch.h"
+
+#include "OB6ProgramLayout.h"
+
+#include <array>
+
+namespace midikraft {
+
+	// Compresses unpacked OB-6 programs. Most programs differ from a typical program (like the "Basic Program" init patch) in only
+	// a few bytes, so the program is XORed with a reference and the result is stored as runs: number of zero bytes, number of literal bytes, literals.
+	// All counts are varints, so a program that matches the reference in everything but its name takes about 25 bytes
+	class OB6PatchCodec {
+	public:
+		// The reference must be a 1024 byte program, e.g. the data of a Basic Program patch
+		OB6PatchCodec(Synth::PatchData const &reference);
+
+		// The reference that compresses the library best byte by byte: the most common value at each offset
+		static OB6PatchCodec train(std::vector<std::shared_ptr<DataFile>> const &patches);
+
+		Synth::PatchData const &reference() const;
+
+		void encode(const uint8 *program, std::vector<uint8> &out) const;
+		// Returns false if the input is corrupt. program must have room for kOB6ProgramSize bytes
+		bool decode(const uint8 *encoded, size_t size, uint8 *program) const;
+
+	private:
+		Synth::PatchData reference_;
+	};
+
+	// A canonical Huffman code over bytes, with code lengths limited so decoding is a single table lookup per symbol
+	class OB6HuffmanCode {
+	public:
+		static const int kMaxCodeLength = 12;
+
+		// Reads the symbols of one encoded block
+		class Reader {
+		public:
+			Reader(OB6HuffmanCode const &code, const uint8 *data, size_t size);
+
+			bool next(uint8 &symbol);
+			// True if only the padding of the last byte is left
+			bool atEnd() const;
+
+		private:
+			void refill();
+
+			OB6HuffmanCode const &code_;
+			const uint8 *read_;
+			const uint8 *end_;
+			uint64 bits_; // Left aligned
+			int bitCount_;
+		};
+
+		OB6HuffmanCode();
+
+		// Symbols that never occur get no code, so train on everything that is going to be encoded
+		static OB6HuffmanCode train(std::array<uint64, 256> const &frequencies);
+		// Returns an invalid code if the lengths don't form a prefix code
+		static OB6HuffmanCode fromCodeLengths(std::array<uint8, 256> const &lengths);
+
+		bool isValid() const;
+		std::array<uint8, 256> const &codeLengths() const;
+
+		// Appends the code of each byte, the last output byte is padded with zero bits
+		void encode(std::vector<uint8> const &bytes, std::vector<uint8> &out) const;
+
+	private:
+		std::array<uint8, 256> lengths_;
+		std::array<uint16, 256> codes_;
+		std::vector<uint16> table_; // symbol << 4 | length for every kMaxCodeLength bit prefix, 0 for prefixes that are no code
+	};
+
+	// Many programs compressed with one shared reference and a Huffman code trained on the run encoded programs of the library.
+	// There is an offset per program, so every program can be decoded on its own
+	class OB6CompressedLibrary {
+	public:
+		struct Statistics {
+			size_t programs = 0;
+			size_t rawBytes = 0;
+			size_t runEncodedBytes = 0; // Before the Huffman stage
+			size_t compressedBytes = 0; // Including reference, code table and offset index
+			double compressionRatio = 0.0;
+			double decodeMegabytesPerSecond = 0.0;
+		};
+
+		// Patches that are no 1024 byte program are skipped
+		static OB6CompressedLibrary build(OB6PatchCodec const &codec, std::vector<std::shared_ptr<DataFile>> const &patches);
+
+		size_t size() const;
+		bool program(size_t index, Synth::PatchData &result) const;
+
+		bool save(File const &file) const;
+		// nullptr if the file can't be read or is not a valid library
+		static std::shared_ptr<OB6CompressedLibrary> load(File const &file);
+
+		// Decodes every program once and measures the throughput
+		Statistics measure() const;
+
+	private:
+		OB6CompressedLibrary(OB6PatchCodec const &codec, OB6HuffmanCode const &code);
+
+		bool decode(size_t index, uint8 *program) const;
+
+		OB6PatchCodec codec_;
+		OB6HuffmanCode code_;
+		std::vector<uint32> offsets_; // One more than programs, the last one is the end of the data
+		std::vector<uint8> data_;
+		size_t runEncodedBytes_ = 0;
+	};
+
+}
@@ -0,0 +1,125 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6PatchDiff.h"
+
+#include "OB6.h"
+
+#include <boost/format.hpp>
+
+#include <array>
+
+namespace midikraft {
+
+	const size_t kOB6ProgramWords = kOB6ProgramSize / 8;
+
+	typedef std::array<uint64, kOB6ProgramWords> WordMask;
+
+	// 0xff for every byte to compare, 0x00 for the bytes in the blank out zones
+	static WordMask const &compareMask(bool ignoreBlankOutZones) {
+		static WordMask all = []() { WordMask mask; mask.fill(~uint64(0)); return mask; }();
+		static WordMask voiceOnly = []() {
+			std::array<uint8, kOB6ProgramSize> bytes;
+			bytes.fill(0xff);
+			for (auto const &zone : kOB6BlankOutZones) {
+				for (int i = zone.getStart(); i < zone.getEnd() && i < (int)kOB6ProgramSize; i++) {
+					bytes[(size_t)i] = 0;
+				}
+			}
+			WordMask mask;
+			std::memcpy(mask.data(), bytes.data(), kOB6ProgramSize);
+			return mask;
+		}();
+		return ignoreBlankOutZones ? voiceOnly : all;
+	}
+
+	static uint64 loadWord(const uint8 *data, size_t word) {
+		uint64 result;
+		std::memcpy(&result, data + word * 8, sizeof(result));
+		return result;
+	}
+
+	// Number of non-zero bytes in a word, without a loop over the bytes
+	static int nonZeroBytes(uint64 x) {
+		const uint64 low7 = 0x7f7f7f7f7f7f7f7fULL;
+		// High bit of each byte set if the byte is non-zero
+		uint64 flags = (((x & low7) + low7) | x) & ~low7;
+		int count = 0;
+		for (; flags; flags &= flags - 1) count++;
+		return count;
+	}
+
+	static bool comparable(std::vector<uint8> const &a, std::vector<uint8> const &b) {
+		return a.size() >= kOB6ProgramSize && b.size() >= kOB6ProgramSize;
+	}
+
+	static std::string nameOfByte(int offset) {
+		int index = kOB6ParameterIndexByOffset[(size_t)offset];
+		if (index >= 0) {
+			return kOB6ParameterLayout[index].name;
+		}
+		if (offset >= kOB6ProgramNameStart && offset < kOB6ProgramNameEnd) {
+			return "Name";
+		}
+		return (boost::format("Byte %d") % offset).str();
+	}
+
+	std::vector<OB6PatchDiff::Region> OB6PatchDiff::diff(std::vector<uint8> const &a, std::vector<uint8> const &b, bool ignoreBlankOutZones)
+	{
+		std::vector<Region> result;
+		if (!comparable(a, b)) {
+			return result;
+		}
+		auto const &mask = compareMask(ignoreBlankOutZones);
+		for (size_t word = 0; word < kOB6ProgramWords; word++) {
+			uint64 difference = (loadWord(a.data(), word) ^ loadWord(b.data(), word)) & mask[word];
+			if (!difference) continue;
+			for (int byte = 0; byte < 8; byte++) {
+				if (!(difference & (uint64(0xff) << (byte * 8)))) continue;
+				int offset = (int)word * 8 + byte;
+				auto name = nameOfByte(offset);
+				if (!result.empty() && result.back().end == offset) {
+					// Extend the current region
+					result.back().end = offset + 1;
+					if (result.back().parameterNames.back() != name) {
+						result.back().parameterNames.push_back(name);
+					}
+				}
+				else {
+					result.push_back({ offset, offset + 1, { name } });
+				}
+			}
+		}
+		return result;
+	}
+
+	int OB6PatchDiff::countDifferentBytes(std::vector<uint8> const &a, std::vector<uint8> const &b, bool ignoreBlankOutZones)
+	{
+		if (!comparable(a, b)) {
+			return -1;
+		}
+		auto const &mask = compareMask(ignoreBlankOutZones);
+		int count = 0;
+		for (size_t word = 0; word < kOB6ProgramWords; word++) {
+			uint64 difference = (loadWord(a.data(), word) ^ loadWord(b.data(), word)) & mask[word];
+			if (difference) {
+				count += nonZeroBytes(difference);
+			}
+		}
+		return count;
+	}
+
+	std::vector<int> OB6PatchDiff::countDifferentBytes(std::vector<uint8> const &patch, std::vector<std::shared_ptr<DataFile>> const &library, bool ignoreBlankOutZones)
+	{
+		std::vector<int> result;
+		result.reserve(library.size());
+		for (auto const &other : library) {
+			result.push_back(other ? countDifferentBytes(patch, other->data(), ignoreBlankOutZones) : -1);
+		}
+		return result;
+	}
+
+}
@@ -0,0 +1,35 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "OB6ProgramLayout.h"
+
+namespace midikraft {
+
+	class DataFile;
+
+	// Byte level comparison of two unpacked OB-6 programs. The data is compared eight bytes at a time, and only words that differ are looked at in detail,
+	// so one comparison is only a few dozen instructions. Differences are reported as regions of consecutive bytes with the names of the parameters in them
+	class OB6PatchDiff {
+	public:
+		struct Region {
+			int start;
+			int end; // exclusive
+			std::vector<std::string> parameterNames;
+		};
+
+		// With ignoreBlankOutZones, the bytes in kOB6BlankOutZones (the name) are not compared
+		static std::vector<Region> diff(std::vector<uint8> const &a, std::vector<uint8> const &b, bool ignoreBlankOutZones);
+		static int countDifferentBytes(std::vector<uint8> const &a, std::vector<uint8> const &b, bool ignoreBlankOutZones);
+
+		// Number of differing bytes between the patch and every patch of the library, e.g. to find the closest relatives
+		static std::vector<int> countDifferentBytes(std::vector<uint8> const &patch, std::vector<std::shared_ptr<DataFile>> const &library, bool ignoreBlankOutZones);
+	};
+
+}
@@ -0,0 +1,100 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6PatchGenerator.h"
+
+#include "OB6Parallel.h"
+
+#include <random>
+
+namespace midikraft {
+
+	// SplitMix64, to turn seed and candidate index into well distributed seeds for the per candidate random engines
+	static uint64 mixSeed(uint64 seed, uint64 index) {
+		uint64 z = seed + 0x9e3779b97f4a7c15ULL * (index + 1);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+
+	// The std distributions differ between standard libraries, but the output of std::mt19937_64 is fixed by the standard.
+	// Deriving the values directly from it keeps a seed's candidates the same on every platform
+	static double unitInterval(std::mt19937_64 &random) {
+		return (random() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	static int uniformInt(std::mt19937_64 &random, int minValue, int maxValue) {
+		// The modulo bias is below 1e-17 for the small ranges used here
+		return minValue + (int)(random() % (uint64)(maxValue - minValue + 1));
+	}
+
+	OB6PatchGenerator::OB6PatchGenerator(std::shared_ptr<OB6> synth) : synth_(synth)
+	{
+	}
+
+	std::vector<std::shared_ptr<OB6Patch>> OB6PatchGenerator::randomize(std::vector<std::shared_ptr<OB6Patch>> const &parents, Options const &options) const
+	{
+		return generate(parents, options, false);
+	}
+
+	std::vector<std::shared_ptr<OB6Patch>> OB6PatchGenerator::breed(std::vector<std::shared_ptr<OB6Patch>> const &parents, Options const &options) const
+	{
+		return generate(parents, options, true);
+	}
+
+	std::vector<MidiMessage> OB6PatchGenerator::encode(std::vector<std::shared_ptr<OB6Patch>> const &patches, int firstProgram, int threads) const
+	{
+		std::vector<MidiMessage> result(patches.size());
+		// The bank byte of a program dump must stay within the 10 banks, so slots wrap around after program 999
+		int slots = synth_->numberOfBanks() * synth_->numberOfPatches();
+		ob6ParallelFor(patches.size(), threads, [this, &patches, &result, firstProgram, slots](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				int slot = (int)(((int64)firstProgram + (int64)i) % slots);
+				if (slot < 0) slot += slots;
+				auto dump = synth_->patchToProgramDumpSysex(patches[i], MidiProgramNumber::fromZeroBase(slot));
+				if (!dump.empty()) {
+					result[i] = dump[0];
+				}
+			}
+		});
+		return result;
+	}
+
+	std::vector<std::shared_ptr<OB6Patch>> OB6PatchGenerator::generate(std::vector<std::shared_ptr<OB6Patch>> const &parents, Options const &options, bool crossover) const
+	{
+		std::vector<std::shared_ptr<OB6Patch>> result((size_t)std::max(0, options.count));
+		if (parents.empty()) {
+			return {};
+		}
+		ob6ParallelFor(result.size(), options.threads, [&](size_t begin, size_t end) {
+			std::mt19937_64 random; // One engine per worker, reseeded for every candidate
+			int lastParent = (int)parents.size() - 1;
+			for (size_t i = begin; i < end; i++) {
+				random.seed(mixSeed(options.seed, i));
+				auto const &first = parents[(size_t)uniformInt(random, 0, lastParent)];
+				auto const &second = crossover ? parents[(size_t)uniformInt(random, 0, lastParent)] : first;
+				auto child = std::make_shared<OB6Patch>(OB6::PATCH, first->data(), MidiProgramNumber::fromZeroBase(0));
+				for (auto const &definition : kOB6ParameterLayout) {
+					int value = unitInterval(random) < 0.5 ? first->parameter(definition.parameter) : second->parameter(definition.parameter);
+					if (unitInterval(random) < options.mutationRate) {
+						if (definition.range() < 16) {
+							// Switches and selectors get a new random value instead of a small step
+							value = uniformInt(random, definition.minValue, definition.maxValue);
+						}
+						else {
+							int maxStep = std::max(1, (int)(definition.range() * options.mutationStrength));
+							value += uniformInt(random, -maxStep, maxStep);
+						}
+					}
+					child->setParameter(definition.parameter, value);
+				}
+				result[i] = child;
+			}
+		});
+		return result;
+	}
+
+}
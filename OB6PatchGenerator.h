@@ -0,0 +1,43 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "OB6.h"
+#include "OB6Patch.h"
+
+namespace midikraft {
+
+	// Creates new OB-6 programs from existing ones, either by mutating a single parent or by crossing two parents and mutating the child.
+	// Only the parameters of the program layout are changed, and always within their ranges; all other bytes come from the first parent.
+	// Candidates are generated in parallel, but every candidate has its own random sequence derived from the seed and its index,
+	// so the result for a given seed depends neither on the number of threads nor on the standard library
+	class OB6PatchGenerator {
+	public:
+		struct Options {
+			int count = 100;
+			uint64 seed = 0;
+			double mutationRate = 0.2; // Probability that a parameter is mutated
+			double mutationStrength = 0.25; // Maximum change relative to the parameter's range
+			int threads = 0; // 0 means one per core
+		};
+
+		OB6PatchGenerator(std::shared_ptr<OB6> synth);
+
+		std::vector<std::shared_ptr<OB6Patch>> randomize(std::vector<std::shared_ptr<OB6Patch>> const &parents, Options const &options) const;
+		std::vector<std::shared_ptr<OB6Patch>> breed(std::vector<std::shared_ptr<OB6Patch>> const &parents, Options const &options) const;
+
+		// Program dumps for the candidates, placed in consecutive program slots starting at firstProgram.
+		// The OB-6 has 1000 slots, so after slot 999 the dumps wrap around to 0 and overwrite earlier candidates
+		std::vector<MidiMessage> encode(std::vector<std::shared_ptr<OB6Patch>> const &patches, int firstProgram, int threads = 0) const;
+
+	private:
+		std::vector<std::shared_ptr<OB6Patch>> generate(std::vector<std::shared_ptr<OB6Patch>> const &parents, Options const &options, bool crossover) const;
+
+		std::shared_ptr<OB6> synth_;
+	};
+
+}
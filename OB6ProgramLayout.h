@@ -0,0 +1,199 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+namespace midikraft {
+
+	// The program parameters of the OB-6. The unpacked 1024 byte program data follows the NRPN numbering, so the value of each
+	// enum is its NRPN number and its byte offset at the same time (the 20 name characters are NRPNs 107 to 126 as well)
+	enum OB6Parameter {
+		OSC1_FREQUENCY = 0,
+		OSC2_FREQUENCY = 1,
+		OSC2_DETUNE = 2,
+		OSC1_SHAPE = 3,
+		OSC2_SHAPE = 4,
+		OSC1_PULSE_WIDTH = 5,
+		OSC2_PULSE_WIDTH = 6,
+		OSC1_SYNC = 7,
+		OSC2_LOW_FREQUENCY = 8,
+		OSC2_KEYBOARD = 9,
+		OSC1_LEVEL = 10,
+		OSC2_LEVEL = 11,
+		SUB_OCTAVE_LEVEL = 12,
+		NOISE_LEVEL = 13,
+		GLIDE_RATE = 14,
+		GLIDE_ON = 15,
+		SLOP = 16,
+		PITCH_BEND_RANGE = 17,
+		KEY_MODE = 18,
+		FILTER_CUTOFF = 20,
+		FILTER_RESONANCE = 21,
+		FILTER_MODE = 22,
+		FILTER_KEY_AMOUNT = 23,
+		FILTER_ENV_AMOUNT = 24,
+		FILTER_VELOCITY = 25,
+		FILTER_BANDPASS = 26,
+		FILTER_ENV_ATTACK = 30,
+		FILTER_ENV_DECAY = 31,
+		FILTER_ENV_SUSTAIN = 32,
+		FILTER_ENV_RELEASE = 33,
+		AMP_ENV_ATTACK = 40,
+		AMP_ENV_DECAY = 41,
+		AMP_ENV_SUSTAIN = 42,
+		AMP_ENV_RELEASE = 43,
+		AMP_VELOCITY = 44,
+		PROGRAM_VOLUME = 45,
+		LFO_FREQUENCY = 50,
+		LFO_SHAPE = 51,
+		LFO_AMOUNT = 52,
+		LFO_SYNC = 53,
+		LFO_DEST_OSC1_FREQUENCY = 54,
+		LFO_DEST_OSC2_FREQUENCY = 55,
+		LFO_DEST_PULSE_WIDTH = 56,
+		LFO_DEST_AMP = 57,
+		LFO_DEST_FILTER = 58,
+		XMOD_FILTER_ENV_AMOUNT = 60,
+		XMOD_OSC2_AMOUNT = 61,
+		XMOD_DEST_OSC1_FREQUENCY = 62,
+		XMOD_DEST_OSC1_SHAPE = 63,
+		XMOD_DEST_PULSE_WIDTH = 64,
+		XMOD_DEST_FILTER = 65,
+		ARP_ON = 70,
+		ARP_MODE = 71,
+		ARP_RANGE = 72,
+		ARP_CLOCK_DIVIDE = 73,
+		TEMPO = 74,
+		FX1_TYPE = 80,
+		FX1_MIX = 81,
+		FX1_PARAM1 = 82,
+		FX1_PARAM2 = 83,
+		FX1_SYNC = 84,
+		FX2_TYPE = 85,
+		FX2_MIX = 86,
+		FX2_PARAM1 = 87,
+		FX2_PARAM2 = 88,
+		FX2_SYNC = 89,
+		FX_ON = 90,
+		AFTERTOUCH_AMOUNT = 95,
+		UNISON_ON = 100,
+		UNISON_DETUNE = 101,
+	};
+
+	struct OB6ParameterDefinition {
+		OB6Parameter parameter;
+		int minValue;
+		int maxValue;
+		const char *name;
+
+		constexpr int offset() const { return parameter; }
+		constexpr int nrpn() const { return parameter; }
+		constexpr int range() const { return maxValue - minValue; }
+	};
+
+	constexpr OB6ParameterDefinition kOB6ParameterLayout[] = {
+		{ OSC1_FREQUENCY, 0, 60, "Osc 1 Frequency" },
+		{ OSC2_FREQUENCY, 0, 60, "Osc 2 Frequency" },
+		{ OSC2_DETUNE, 0, 254, "Osc 2 Detune" },
+		{ OSC1_SHAPE, 0, 254, "Osc 1 Shape" },
+		{ OSC2_SHAPE, 0, 254, "Osc 2 Shape" },
+		{ OSC1_PULSE_WIDTH, 0, 254, "Osc 1 Pulse Width" },
+		{ OSC2_PULSE_WIDTH, 0, 254, "Osc 2 Pulse Width" },
+		{ OSC1_SYNC, 0, 1, "Osc 1 Sync" },
+		{ OSC2_LOW_FREQUENCY, 0, 1, "Osc 2 Low Freq" },
+		{ OSC2_KEYBOARD, 0, 1, "Osc 2 Keyboard" },
+		{ OSC1_LEVEL, 0, 127, "Osc 1 Level" },
+		{ OSC2_LEVEL, 0, 127, "Osc 2 Level" },
+		{ SUB_OCTAVE_LEVEL, 0, 127, "Sub Octave Level" },
+		{ NOISE_LEVEL, 0, 127, "Noise Level" },
+		{ GLIDE_RATE, 0, 254, "Glide Rate" },
+		{ GLIDE_ON, 0, 1, "Glide On" },
+		{ SLOP, 0, 254, "Slop" },
+		{ PITCH_BEND_RANGE, 0, 24, "Pitch Bend Range" },
+		{ KEY_MODE, 0, 5, "Key Mode" },
+		{ FILTER_CUTOFF, 0, 164, "Filter Cutoff" },
+		{ FILTER_RESONANCE, 0, 254, "Filter Resonance" },
+		{ FILTER_MODE, 0, 254, "Filter Mode" },
+		{ FILTER_KEY_AMOUNT, 0, 2, "Filter Key Amount" },
+		{ FILTER_ENV_AMOUNT, 0, 254, "Filter Env Amount" },
+		{ FILTER_VELOCITY, 0, 1, "Filter Velocity" },
+		{ FILTER_BANDPASS, 0, 1, "Filter Band Pass" },
+		{ FILTER_ENV_ATTACK, 0, 254, "Filter Env Attack" },
+		{ FILTER_ENV_DECAY, 0, 254, "Filter Env Decay" },
+		{ FILTER_ENV_SUSTAIN, 0, 254, "Filter Env Sustain" },
+		{ FILTER_ENV_RELEASE, 0, 254, "Filter Env Release" },
+		{ AMP_ENV_ATTACK, 0, 254, "Amp Env Attack" },
+		{ AMP_ENV_DECAY, 0, 254, "Amp Env Decay" },
+		{ AMP_ENV_SUSTAIN, 0, 254, "Amp Env Sustain" },
+		{ AMP_ENV_RELEASE, 0, 254, "Amp Env Release" },
+		{ AMP_VELOCITY, 0, 1, "Amp Velocity" },
+		{ PROGRAM_VOLUME, 0, 127, "Program Volume" },
+		{ LFO_FREQUENCY, 0, 254, "LFO Frequency" },
+		{ LFO_SHAPE, 0, 4, "LFO Shape" },
+		{ LFO_AMOUNT, 0, 254, "LFO Amount" },
+		{ LFO_SYNC, 0, 1, "LFO Sync" },
+		{ LFO_DEST_OSC1_FREQUENCY, 0, 1, "LFO to Osc 1 Freq" },
+		{ LFO_DEST_OSC2_FREQUENCY, 0, 1, "LFO to Osc 2 Freq" },
+		{ LFO_DEST_PULSE_WIDTH, 0, 1, "LFO to Pulse Width" },
+		{ LFO_DEST_AMP, 0, 1, "LFO to Amp" },
+		{ LFO_DEST_FILTER, 0, 1, "LFO to Filter" },
+		{ XMOD_FILTER_ENV_AMOUNT, 0, 254, "X-Mod Filter Env" },
+		{ XMOD_OSC2_AMOUNT, 0, 254, "X-Mod Osc 2" },
+		{ XMOD_DEST_OSC1_FREQUENCY, 0, 1, "X-Mod to Osc 1 Freq" },
+		{ XMOD_DEST_OSC1_SHAPE, 0, 1, "X-Mod to Osc 1 Shape" },
+		{ XMOD_DEST_PULSE_WIDTH, 0, 1, "X-Mod to Pulse Width" },
+		{ XMOD_DEST_FILTER, 0, 1, "X-Mod to Filter" },
+		{ ARP_ON, 0, 1, "Arp On" },
+		{ ARP_MODE, 0, 4, "Arp Mode" },
+		{ ARP_RANGE, 0, 2, "Arp Range" },
+		{ ARP_CLOCK_DIVIDE, 0, 12, "Arp Clock Divide" },
+		{ TEMPO, 30, 250, "Tempo" },
+		{ FX1_TYPE, 0, 13, "FX 1 Type" },
+		{ FX1_MIX, 0, 127, "FX 1 Mix" },
+		{ FX1_PARAM1, 0, 255, "FX 1 Param 1" },
+		{ FX1_PARAM2, 0, 127, "FX 1 Param 2" },
+		{ FX1_SYNC, 0, 1, "FX 1 Sync" },
+		{ FX2_TYPE, 0, 13, "FX 2 Type" },
+		{ FX2_MIX, 0, 127, "FX 2 Mix" },
+		{ FX2_PARAM1, 0, 255, "FX 2 Param 1" },
+		{ FX2_PARAM2, 0, 127, "FX 2 Param 2" },
+		{ FX2_SYNC, 0, 1, "FX 2 Sync" },
+		{ FX_ON, 0, 1, "FX On" },
+		{ AFTERTOUCH_AMOUNT, 0, 254, "Aftertouch Amount" },
+		{ UNISON_ON, 0, 1, "Unison On" },
+		{ UNISON_DETUNE, 0, 7, "Unison Detune" },
+	};
+
+	constexpr size_t kOB6NumberOfParameters = sizeof(kOB6ParameterLayout) / sizeof(kOB6ParameterLayout[0]);
+	constexpr int kOB6ProgramNameStart = 107;
+	constexpr int kOB6ProgramNameEnd = 127;
+	constexpr size_t kOB6ProgramSize = 1024;
+
+	// Reverse lookup from the byte offset to the index into kOB6ParameterLayout, -1 for bytes that are no parameter
+	constexpr std::array<int, kOB6ProgramSize> ob6ParameterIndexByOffset() {
+		std::array<int, kOB6ProgramSize> result{};
+		for (size_t i = 0; i < kOB6ProgramSize; i++) result[i] = -1;
+		for (size_t i = 0; i < kOB6NumberOfParameters; i++) result[(size_t)kOB6ParameterLayout[i].offset()] = (int)i;
+		return result;
+	}
+	constexpr std::array<int, kOB6ProgramSize> kOB6ParameterIndexByOffset = ob6ParameterIndexByOffset();
+
+	constexpr OB6ParameterDefinition const &ob6ParameterDefinition(OB6Parameter parameter) {
+		return kOB6ParameterLayout[kOB6ParameterIndexByOffset[(size_t)parameter]];
+	}
+
+	// Bytes that can be changed in the edit buffer with an NRPN - all parameters and the name characters
+	constexpr bool isOB6NRPNAddressable(size_t offset) {
+		return offset < kOB6ProgramSize && (kOB6ParameterIndexByOffset[offset] >= 0 || (offset >= (size_t)kOB6ProgramNameStart && offset < (size_t)kOB6ProgramNameEnd));
+	}
+
+	static_assert(kOB6ParameterLayout[kOB6NumberOfParameters - 1].offset() < kOB6ProgramNameStart, "Program parameters must not overlap the name");
+	static_assert(ob6ParameterDefinition(FILTER_CUTOFF).maxValue == 164, "Reverse lookup must find the parameter definition");
+
+}
@@ -0,0 +1,142 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6Requester.h"
+
+#include "MidiTuning.h"
+
+#include <algorithm>
+
+namespace midikraft {
+
+	OB6Requester::OB6Requester(std::shared_ptr<OB6> synth, std::shared_ptr<OB6Transport> transport, int timeoutMilliseconds) :
+		synth_(synth), transport_(transport), incomingHandle_(MidiController::makeOneHandle()), timeoutMilliseconds_(timeoutMilliseconds)
+	{
+		replies_ = std::make_unique<OB6DecodeQueue>([this](MidiMessage const &message) { decodeReply(message); });
+		timeoutThread_ = std::thread([this]() { expireRequests(); });
+		transport_->addIncomingHandler(incomingHandle_, [this](MidiMessage const &message) {
+			if (message.isSysEx()) {
+				replies_->push(message);
+			}
+		});
+	}
+
+	OB6Requester::~OB6Requester()
+	{
+		// After this returns, no handler call is running anymore that could push to the queue
+		transport_->removeIncomingHandler(incomingHandle_);
+		replies_.reset();
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			shouldExit_ = true;
+		}
+		pendingChanged_.notify_all();
+		timeoutThread_.join();
+		for (auto &pending : pending_) {
+			pending.promise.set_value(nullptr);
+		}
+	}
+
+	std::future<std::shared_ptr<DataFile>> OB6Requester::fetchProgram(MidiProgramNumber programNo)
+	{
+		return fetch(OB6::MessageKind::PROGRAM_DUMP, programNo.toZeroBased(), synth_->requestDataItem(programNo.toZeroBased(), DataStreamType(OB6::PATCH)));
+	}
+
+	std::future<std::shared_ptr<DataFile>> OB6Requester::fetchGlobals()
+	{
+		return fetch(OB6::MessageKind::GLOBAL_DUMP, 0, synth_->requestDataItem(0, DataStreamType(OB6::GLOBAL_SETTINGS)));
+	}
+
+	std::future<std::shared_ptr<DataFile>> OB6Requester::fetchTuning(MidiProgramNumber tuningNo)
+	{
+		return fetch(OB6::MessageKind::TUNING_DUMP, tuningNo.toZeroBased(), synth_->requestDataItem(tuningNo.toZeroBased(), DataStreamType(OB6::ALTERNATE_TUNING)));
+	}
+
+	size_t OB6Requester::outstanding() const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return pending_.size();
+	}
+
+	std::future<std::shared_ptr<DataFile>> OB6Requester::fetch(OB6::MessageKind kind, int number, std::vector<MidiMessage> const &request)
+	{
+		std::future<std::shared_ptr<DataFile>> result;
+		{
+			// Register before sending, the reply might be faster than us
+			std::lock_guard<std::mutex> lock(mutex_);
+			Pending pending{ kind, number, std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMilliseconds_), std::promise<std::shared_ptr<DataFile>>() };
+			result = pending.promise.get_future();
+			pending_.push_back(std::move(pending));
+		}
+		pendingChanged_.notify_all();
+		transport_->send(request);
+		return result;
+	}
+
+	void OB6Requester::decodeReply(MidiMessage const &message)
+	{
+		auto kind = synth_->classifyMessage(message);
+		int number = 0;
+		switch (kind) {
+		case OB6::MessageKind::PROGRAM_DUMP:
+			number = message.getSysExData()[3] * synth_->numberOfPatches() + message.getSysExData()[4];
+			break;
+		case OB6::MessageKind::TUNING_DUMP:
+			// 7E <device> 08 01 <tuning program>
+			number = message.getSysExDataSize() > 4 ? message.getSysExData()[4] : 0;
+			break;
+		case OB6::MessageKind::GLOBAL_DUMP:
+			break;
+		default:
+			return;
+		}
+
+		std::promise<std::shared_ptr<DataFile>> promise;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			// The oldest request waiting for exactly this item gets the reply
+			auto match = std::find_if(pending_.begin(), pending_.end(), [kind, number](Pending const &pending) { return pending.kind == kind && pending.number == number; });
+			if (match == pending_.end()) {
+				return;
+			}
+			promise = std::move(match->promise);
+			pending_.erase(match);
+		}
+
+		std::shared_ptr<DataFile> dataFile;
+		if (kind == OB6::MessageKind::PROGRAM_DUMP) {
+			dataFile = synth_->patchFromSysex(message);
+		}
+		else {
+			auto loaded = synth_->loadData({ message }, DataStreamType(kind == OB6::MessageKind::GLOBAL_DUMP ? OB6::GLOBAL_SETTINGS : OB6::ALTERNATE_TUNING));
+			if (!loaded.empty()) {
+				dataFile = loaded[0];
+			}
+		}
+		promise.set_value(dataFile);
+	}
+
+	void OB6Requester::expireRequests()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		while (!shouldExit_) {
+			auto now = std::chrono::steady_clock::now();
+			auto nextDeadline = now + std::chrono::seconds(1);
+			for (auto pending = pending_.begin(); pending != pending_.end();) {
+				if (pending->deadline <= now) {
+					pending->promise.set_value(nullptr);
+					pending = pending_.erase(pending);
+				}
+				else {
+					nextDeadline = std::min(nextDeadline, pending->deadline);
+					++pending;
+				}
+			}
+			pendingChanged_.wait_until(lock, nextDeadline);
+		}
+	}
+
+}
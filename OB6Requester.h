@@ -0,0 +1,58 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "OB6.h"
+#include "OB6Transport.h"
+#include "OB6DecodeQueue.h"
+
+#include <future>
+#include <list>
+
+namespace midikraft {
+
+	// Asynchronous requests for OB-6 data items. Every fetch sends the request right away and returns a future, which is fulfilled when the matching reply
+	// arrives, or with an empty pointer when the timeout expires. Replies are matched by opcode and, for programs, by the bank and program bytes of the 0x02 header.
+	// Any number of requests can be outstanding. The MIDI thread only queues the raw reply, decoding happens on the decode queue's worker
+	class OB6Requester {
+	public:
+		// Listens on the transport next to its other users, so it can share the transport of an OB6Unit
+		OB6Requester(std::shared_ptr<OB6> synth, std::shared_ptr<OB6Transport> transport, int timeoutMilliseconds = 1000);
+		~OB6Requester();
+
+		std::future<std::shared_ptr<DataFile>> fetchProgram(MidiProgramNumber programNo);
+		std::future<std::shared_ptr<DataFile>> fetchGlobals();
+		std::future<std::shared_ptr<DataFile>> fetchTuning(MidiProgramNumber tuningNo);
+
+		size_t outstanding() const;
+
+	private:
+		struct Pending {
+			OB6::MessageKind kind;
+			int number;
+			std::chrono::steady_clock::time_point deadline;
+			std::promise<std::shared_ptr<DataFile>> promise;
+		};
+
+		std::future<std::shared_ptr<DataFile>> fetch(OB6::MessageKind kind, int number, std::vector<MidiMessage> const &request);
+		void decodeReply(MidiMessage const &message);
+		void expireRequests();
+
+		std::shared_ptr<OB6> synth_;
+		std::shared_ptr<OB6Transport> transport_;
+		MidiController::HandlerHandle incomingHandle_;
+		int timeoutMilliseconds_;
+
+		mutable std::mutex mutex_;
+		std::condition_variable pendingChanged_;
+		std::list<Pending> pending_;
+		bool shouldExit_ = false;
+		std::thread timeoutThread_;
+		std::unique_ptr<OB6DecodeQueue> replies_;
+	};
+
+}
@@ -0,0 +1,225 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6Session.h"
+
+#include "Patch.h"
+
+#include <boost/format.hpp>
+
+#include <chrono>
+#include <thread>
+
+namespace midikraft {
+
+	OB6Unit::OB6Unit(std::shared_ptr<OB6Transport> transport, MidiChannel channel) : transport_(transport), incomingHandle_(MidiController::makeOneHandle()), synth_(std::make_shared<OB6>()), channel_(channel), contents_(synth_)
+	{
+		synth_->setCurrentChannelZeroBased(transport_->inputName(), transport_->outputName(), channel.isOmni() ? 0 : channel.toZeroBasedInt());
+		transport_->addIncomingHandler(incomingHandle_, [this](MidiMessage const &message) { handleIncoming(message); });
+	}
+
+	OB6Unit::~OB6Unit()
+	{
+		transport_->removeIncomingHandler(incomingHandle_);
+	}
+
+	std::string OB6Unit::name() const
+	{
+		return (boost::format("%s (channel %d)") % transport_->outputName() % channel_.toOneBasedInt()).str();
+	}
+
+	std::shared_ptr<OB6> OB6Unit::synth() const
+	{
+		return synth_;
+	}
+
+	std::shared_ptr<OB6Transport> OB6Unit::transport() const
+	{
+		return transport_;
+	}
+
+	OB6DeviceContents & OB6Unit::contents()
+	{
+		return contents_;
+	}
+
+	bool OB6Unit::refreshGlobalSettings(int timeoutMilliseconds)
+	{
+		MidiMessage reply;
+		if (sendAndWaitFor(synth_->deviceDetect(channel_.toZeroBasedInt()), [this](MidiMessage const &message) { return synth_->channelFromGlobalSettingsDump(message).isValid(); }, timeoutMilliseconds, reply)) {
+			synth_->channelIfValidDeviceResponse(reply);
+			return true;
+		}
+		return false;
+	}
+
+	std::vector<std::shared_ptr<DataFile>> OB6Unit::backup(ProgressCallback progress, int timeoutMilliseconds)
+	{
+		std::vector<std::shared_ptr<DataFile>> result;
+		int total = synth_->numberOfBanks() * synth_->numberOfPatches();
+		double start = Time::getMillisecondCounterHiRes();
+		for (int programNo = 0; programNo < total; programNo++) {
+			// One retry, a single dropped dump should not fail the whole backup
+			for (int attempt = 0; attempt < 2; attempt++) {
+				MidiMessage reply;
+				bool received = sendAndWaitFor(synth_->requestDataItem(programNo, DataStreamType(OB6::PATCH)), [this, programNo](MidiMessage const &message) {
+					if (synth_->classifyMessage(message) != OB6::MessageKind::PROGRAM_DUMP) return false;
+					auto patch = std::dynamic_pointer_cast<Patch>(synth_->patchFromSysex(message));
+					return patch && patch->patchNumber().toZeroBased() == programNo;
+				}, timeoutMilliseconds, reply);
+				if (received) {
+					auto patch = synth_->patchFromSysex(reply);
+					contents_.remember(programNo, patch);
+					result.push_back(patch);
+					break;
+				}
+			}
+			if (progress) {
+				progress(*this, { programNo + 1, total, Time::getMillisecondCounterHiRes() - start });
+			}
+		}
+		return result;
+	}
+
+	int OB6Unit::restore(std::vector<std::shared_ptr<DataFile>> const &programs, ProgressCallback progress, int gapMilliseconds)
+	{
+		int sent = 0;
+		int total = (int)programs.size();
+		double start = Time::getMillisecondCounterHiRes();
+		for (auto const &program : programs) {
+			auto patch = std::dynamic_pointer_cast<Patch>(program);
+			if (patch) {
+				transport_->send(synth_->patchToProgramDumpSysex(patch, patch->patchNumber()));
+				contents_.remember(patch->patchNumber().toZeroBased(), patch);
+				sent++;
+				// The OB-6 needs time to store the program, else it drops the next dump
+				std::this_thread::sleep_for(std::chrono::milliseconds(gapMilliseconds));
+			}
+			if (progress) {
+				progress(*this, { sent, total, Time::getMillisecondCounterHiRes() - start });
+			}
+		}
+		return sent;
+	}
+
+	std::vector<std::shared_ptr<TypedNamedValue>> OB6Unit::pushGlobalSettings(std::shared_ptr<DataFile> targetSettings, int timeoutMilliseconds)
+	{
+		// The push only sends what differs from our copy of the globals, so that copy must reflect the device and not the defaults
+		if (!refreshGlobalSettings(timeoutMilliseconds)) {
+			return synth_->getGlobalSettings();
+		}
+		return synth_->pushGlobalSettings(targetSettings, [this](std::vector<MidiMessage> const &messages) {
+			transport_->send(messages);
+		});
+	}
+
+	bool OB6Unit::sendAndWaitFor(std::vector<MidiMessage> const &request, std::function<bool(MidiMessage const &)> predicate, int timeoutMilliseconds, MidiMessage &result)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		// Start listening before sending, the OB6Simulator replies from within send()
+		inbox_.clear();
+		waiting_ = true;
+		lock.unlock();
+		transport_->send(request);
+		lock.lock();
+
+		bool found = false;
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+		do {
+			while (!inbox_.empty() && !found) {
+				auto message = inbox_.front();
+				inbox_.pop_front();
+				if (predicate(message)) {
+					result = message;
+					found = true;
+				}
+			}
+		} while (!found && messageArrived_.wait_until(lock, deadline, [this]() { return !inbox_.empty(); }));
+		waiting_ = false;
+		inbox_.clear();
+		return found;
+	}
+
+	void OB6Unit::handleIncoming(MidiMessage const &message)
+	{
+		if (!message.isSysEx()) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (waiting_) {
+			inbox_.push_back(message);
+			messageArrived_.notify_all();
+		}
+	}
+
+	void OB6Rack::addUnit(std::shared_ptr<OB6Unit> unit)
+	{
+		units_.push_back(unit);
+	}
+
+	std::vector<std::shared_ptr<OB6Unit>> OB6Rack::units() const
+	{
+		return units_;
+	}
+
+	OB6Rack OB6Rack::fromDetections(std::vector<OB6Detector::Detection> const &detections, MidiController *controller)
+	{
+		OB6Rack rack;
+		for (auto const &detection : detections) {
+			auto transport = std::make_shared<MidiControllerTransport>(controller, detection.input, detection.output);
+			rack.addUnit(std::make_shared<OB6Unit>(transport, detection.channel));
+		}
+		return rack;
+	}
+
+	std::vector<OB6Rack::UnitResult> OB6Rack::backupAll(std::map<std::string, std::vector<std::shared_ptr<DataFile>>> &backups, OB6Unit::ProgressCallback progress)
+	{
+		std::mutex resultMutex;
+		return runParallel([&](OB6Unit &unit) {
+			auto programs = unit.backup(progress);
+			bool complete = (int)programs.size() == unit.synth()->numberOfBanks() * unit.synth()->numberOfPatches();
+			std::lock_guard<std::mutex> lock(resultMutex);
+			backups[unit.name()] = programs;
+			return complete;
+		});
+	}
+
+	std::vector<OB6Rack::UnitResult> OB6Rack::restoreAll(std::map<std::string, std::vector<std::shared_ptr<DataFile>>> const &backups, OB6Unit::ProgressCallback progress)
+	{
+		return runParallel([&](OB6Unit &unit) {
+			auto backup = backups.find(unit.name());
+			if (backup == backups.end()) {
+				return false;
+			}
+			return unit.restore(backup->second, progress) == (int)backup->second.size();
+		});
+	}
+
+	std::vector<OB6Rack::UnitResult> OB6Rack::pushGlobalSettingsAll(std::shared_ptr<DataFile> targetSettings)
+	{
+		return runParallel([&](OB6Unit &unit) {
+			return unit.pushGlobalSettings(targetSettings).empty();
+		});
+	}
+
+	std::vector<OB6Rack::UnitResult> OB6Rack::runParallel(std::function<bool(OB6Unit &unit)> job)
+	{
+		std::vector<UnitResult> results(units_.size());
+		std::vector<std::thread> workers;
+		for (size_t i = 0; i < units_.size(); i++) {
+			workers.emplace_back([this, i, &job, &results]() {
+				double start = Time::getMillisecondCounterHiRes();
+				bool success = job(*units_[i]);
+				results[i] = { units_[i], success, Time::getMillisecondCounterHiRes() - start };
+			});
+		}
+		for (auto &worker : workers) {
+			worker.join();
+		}
+		return results;
+	}
+
+}
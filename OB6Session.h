@@ -0,0 +1,93 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "OB6.h"
+#include "OB6Transport.h"
+#include "OB6Detection.h"
+#include "OB6DeltaSync.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace midikraft {
+
+	// One OB-6 in a rack, identified by its transport (MIDI ports) and channel. Each unit has its own OB6 instance,
+	// so local control, MIDI control, channel and global settings are tracked per device
+	class OB6Unit {
+	public:
+		struct Progress {
+			int done;
+			int total;
+			double elapsedMilliseconds;
+		};
+		// Called on the thread running the operation
+		typedef std::function<void(OB6Unit &unit, Progress const &progress)> ProgressCallback;
+
+		OB6Unit(std::shared_ptr<OB6Transport> transport, MidiChannel channel);
+		virtual ~OB6Unit();
+
+		std::string name() const;
+		std::shared_ptr<OB6> synth() const;
+		std::shared_ptr<OB6Transport> transport() const;
+		// What we know is in the program slots of this unit, updated by backup and restore
+		OB6DeviceContents &contents();
+
+		// Blocking operations, run them on a worker thread
+		bool refreshGlobalSettings(int timeoutMilliseconds = 500);
+		std::vector<std::shared_ptr<DataFile>> backup(ProgressCallback progress, int timeoutMilliseconds = 500);
+		int restore(std::vector<std::shared_ptr<DataFile>> const &programs, ProgressCallback progress, int gapMilliseconds = 20);
+		// Refreshes the globals from the device first. If it does not answer, nothing is sent and all settings are returned as not applied
+		std::vector<std::shared_ptr<TypedNamedValue>> pushGlobalSettings(std::shared_ptr<DataFile> targetSettings, int timeoutMilliseconds = 500);
+
+		// Send the request and wait for the first reply matching the predicate. Only messages arriving after the request went out are looked at,
+		// so a stale reply (e.g. one meant for an OB6Requester sharing the transport) cannot answer it
+		bool sendAndWaitFor(std::vector<MidiMessage> const &request, std::function<bool(MidiMessage const &)> predicate, int timeoutMilliseconds, MidiMessage &result);
+
+	private:
+		void handleIncoming(MidiMessage const &message);
+
+		std::shared_ptr<OB6Transport> transport_;
+		MidiController::HandlerHandle incomingHandle_;
+		std::shared_ptr<OB6> synth_;
+		MidiChannel channel_;
+		OB6DeviceContents contents_;
+
+		std::mutex mutex_;
+		std::condition_variable messageArrived_;
+		std::deque<MidiMessage> inbox_;
+		bool waiting_ = false; // Incoming messages are only queued while a sendAndWaitFor is pending
+	};
+
+	// Several OB-6 units, with operations running in parallel on one thread per unit
+	class OB6Rack {
+	public:
+		struct UnitResult {
+			std::shared_ptr<OB6Unit> unit;
+			bool success;
+			double milliseconds;
+		};
+
+		void addUnit(std::shared_ptr<OB6Unit> unit);
+		std::vector<std::shared_ptr<OB6Unit>> units() const;
+
+		// Create one unit per detected device
+		static OB6Rack fromDetections(std::vector<OB6Detector::Detection> const &detections, MidiController *controller);
+
+		std::vector<UnitResult> backupAll(std::map<std::string, std::vector<std::shared_ptr<DataFile>>> &backups, OB6Unit::ProgressCallback progress);
+		std::vector<UnitResult> restoreAll(std::map<std::string, std::vector<std::shared_ptr<DataFile>>> const &backups, OB6Unit::ProgressCallback progress);
+		std::vector<UnitResult> pushGlobalSettingsAll(std::shared_ptr<DataFile> targetSettings);
+
+		// Run the job on all units at the same time, and wait for all of them to finish
+		std::vector<UnitResult> runParallel(std::function<bool(OB6Unit &unit)> job);
+
+	private:
+		std::vector<std::shared_ptr<OB6Unit>> units_;
+	};
+
+}
@@ -0,0 +1,190 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6Simulator.h"
+
+#include "OB6ProgramLayout.h"
+
+#include "Patch.h"
+#include "MidiHelpers.h"
+
+namespace midikraft {
+
+	const int kOB6GlobalParameterCount = 19;
+
+	OB6Simulator::OB6Simulator(std::string const &portName, MidiChannel channel) : portName_(portName), codec_(std::make_shared<OB6>())
+	{
+		programs_.resize((size_t)(codec_->numberOfBanks() * codec_->numberOfPatches()), Synth::PatchData(kOB6ProgramSize, 0));
+		editBuffer_ = Synth::PatchData(kOB6ProgramSize, 0);
+		globalParameters_.resize(kOB6GlobalParameterCount, 0);
+		// Start with the defaults of the settings definitions
+		auto definitions = codec_->dsiGlobalSettings();
+		auto defaults = codec_->getGlobalSettings();
+		for (size_t i = 0; i < definitions.size() && i < defaults.size(); i++) {
+			if (definitions[i].sysexIndex < kOB6GlobalParameterCount) {
+				globalParameters_[(size_t)definitions[i].sysexIndex] = (uint8)((int)defaults[i]->value().getValue() - definitions[i].displayOffset);
+			}
+		}
+		globalParameters_[2 /* MIDI channel */] = (uint8)(channel.isOmni() ? 0 : channel.toOneBasedInt());
+		codec_->setCurrentChannelZeroBased(portName_, portName_, channel.isOmni() ? 0 : channel.toZeroBasedInt());
+	}
+
+	std::string OB6Simulator::inputName() const
+	{
+		return portName_;
+	}
+
+	std::string OB6Simulator::outputName() const
+	{
+		return portName_;
+	}
+
+	void OB6Simulator::send(std::vector<MidiMessage> const &messages)
+	{
+		std::vector<MidiMessage> replies;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			for (auto const &message : messages) {
+				receive(message, replies);
+			}
+		}
+		// Deliver outside of the lock, the handler might well send the next request right away
+		for (auto const &reply : replies) {
+			dispatch(reply);
+		}
+	}
+
+	Synth::PatchData OB6Simulator::program(int programNo) const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return programs_[(size_t)programNo];
+	}
+
+	void OB6Simulator::setProgram(int programNo, Synth::PatchData const &data)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		programs_[(size_t)programNo] = data;
+	}
+
+	Synth::PatchData OB6Simulator::editBuffer() const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return editBuffer_;
+	}
+
+	int OB6Simulator::globalParameter(int sysexIndex) const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return globalParameters_[(size_t)sysexIndex];
+	}
+
+	void OB6Simulator::setDropRate(double probability, unsigned seed)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		dropRate_ = probability;
+		random_.seed(seed);
+	}
+
+	void OB6Simulator::setMinimumGapMilliseconds(double gap)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		minimumGap_ = gap;
+	}
+
+	int OB6Simulator::droppedDumps() const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return droppedDumps_;
+	}
+
+	void OB6Simulator::receive(MidiMessage const &message, std::vector<MidiMessage> &replies)
+	{
+		if (message.isController()) {
+			// NRPN as created by DSISynth::createNRPN: 99 and 98 select the parameter, 6 and 38 carry the value
+			switch (message.getControllerNumber()) {
+			case 99: nrpnParameter_ = (nrpnParameter_ & 0x7f) | (message.getControllerValue() << 7); break;
+			case 98: nrpnParameter_ = (nrpnParameter_ & ~0x7f) | message.getControllerValue(); break;
+			case 6: nrpnValueMSB_ = message.getControllerValue(); break;
+			case 38: receiveNRPN(nrpnParameter_, (nrpnValueMSB_ << 7) | message.getControllerValue()); break;
+			default: break;
+			}
+			return;
+		}
+		if (!message.isSysEx() || message.getSysExDataSize() < 3) {
+			return;
+		}
+		auto data = message.getSysExData();
+		if (data[0] != 0x01 || data[1] != 0b00101110 /* OB-6 ID */) {
+			return;
+		}
+		switch (data[2]) {
+		case 0x02: /* program data dump */ {
+			// A real OB-6 needs time to store a program, and loses dumps arriving too fast
+			double now = Time::getMillisecondCounterHiRes();
+			bool tooFast = now - lastDumpTime_ < minimumGap_;
+			lastDumpTime_ = now;
+			if (tooFast || (dropRate_ > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(random_) < dropRate_)) {
+				droppedDumps_++;
+				break;
+			}
+			auto patch = std::dynamic_pointer_cast<Patch>(codec_->patchFromSysex(message));
+			if (patch) {
+				programs_[(size_t)patch->patchNumber().toZeroBased()] = patch->data();
+			}
+			break;
+		}
+		case 0x03: /* edit buffer dump */ {
+			auto patch = codec_->patchFromSysex(message);
+			if (patch) {
+				editBuffer_ = patch->data();
+			}
+			break;
+		}
+		case 0x05: /* program request */
+			if (message.getSysExDataSize() > 4) {
+				int programNo = data[3] * codec_->numberOfPatches() + data[4];
+				if (programNo < (int)programs_.size()) {
+					auto patch = codec_->patchFromPatchData(programs_[(size_t)programNo], MidiProgramNumber::fromZeroBase(programNo));
+					auto dump = codec_->patchToProgramDumpSysex(patch, MidiProgramNumber::fromZeroBase(programNo));
+					std::copy(dump.begin(), dump.end(), std::back_inserter(replies));
+				}
+			}
+			break;
+		case 0x06: /* edit buffer request */ {
+			auto dump = codec_->patchToSysex(codec_->patchFromPatchData(editBuffer_, MidiProgramNumber::fromZeroBase(0)));
+			std::copy(dump.begin(), dump.end(), std::back_inserter(replies));
+			break;
+		}
+		case 0x0e: /* global parameter request */
+			replies.push_back(globalParameterDump());
+			break;
+		default:
+			break;
+		}
+	}
+
+	void OB6Simulator::receiveNRPN(int parameterNo, int value)
+	{
+		for (auto const &setting : codec_->dsiGlobalSettings()) {
+			if (setting.nrpn == parameterNo && setting.sysexIndex < kOB6GlobalParameterCount) {
+				globalParameters_[(size_t)setting.sysexIndex] = (uint8)value;
+				return;
+			}
+		}
+		if (parameterNo >= 0 && parameterNo < (int)kOB6ProgramSize) {
+			// Program parameters go into the edit buffer, the program data follows the NRPN numbering
+			editBuffer_[(size_t)parameterNo] = (uint8)value;
+		}
+	}
+
+	MidiMessage OB6Simulator::globalParameterDump() const
+	{
+		std::vector<uint8> dump({ 0x01 /* DSI */, 0b00101110 /* OB-6 ID */, 0x0f /* main parameter data */ });
+		std::copy(globalParameters_.begin(), globalParameters_.end(), std::back_inserter(dump));
+		return MidiHelpers::sysexMessage(dump);
+	}
+
+}
@@ -0,0 +1,61 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "OB6Transport.h"
+#include "OB6.h"
+
+#include <mutex>
+#include <random>
+
+namespace midikraft {
+
+	// A simulated OB-6 behind a transport, answering program, edit buffer and global parameter requests from its own memory.
+	// It stores program and edit buffer dumps sent to it, and applies global parameter NRPNs. Replies are delivered synchronously from within send()
+	class OB6Simulator : public OB6Transport {
+	public:
+		OB6Simulator(std::string const &portName, MidiChannel channel);
+
+		virtual std::string inputName() const override;
+		virtual std::string outputName() const override;
+
+		virtual void send(std::vector<MidiMessage> const &messages) override;
+
+		// Direct access to the simulated memory
+		Synth::PatchData program(int programNo) const;
+		void setProgram(int programNo, Synth::PatchData const &data);
+		Synth::PatchData editBuffer() const;
+		int globalParameter(int sysexIndex) const;
+
+		// Fault injection - drop program dumps at random, or all that arrive less than the given gap after the previous one
+		void setDropRate(double probability, unsigned seed = 0);
+		void setMinimumGapMilliseconds(double gap);
+		int droppedDumps() const;
+
+	private:
+		void receive(MidiMessage const &message, std::vector<MidiMessage> &replies);
+		void receiveNRPN(int parameterNo, int value);
+		MidiMessage globalParameterDump() const;
+
+		std::string portName_;
+		std::shared_ptr<OB6> codec_;
+
+		mutable std::mutex mutex_;
+		std::vector<Synth::PatchData> programs_;
+		Synth::PatchData editBuffer_;
+		std::vector<uint8> globalParameters_;
+		int nrpnParameter_ = 0;
+		int nrpnValueMSB_ = 0;
+
+		double dropRate_ = 0.0;
+		double minimumGap_ = 0.0;
+		double lastDumpTime_ = 0.0;
+		int droppedDumps_ = 0;
+		std::mt19937 random_;
+	};
+
+}
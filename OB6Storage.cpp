@@ -0,0 +1,30 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6Storage.h"
+
+namespace midikraft {
+
+	bool ob6WriteFileReplacing(File const &file, std::function<void(OutputStream &out)> write)
+	{
+		file.getParentDirectory().createDirectory();
+		TemporaryFile temporary(file);
+		{
+			FileOutputStream out(temporary.getFile());
+			if (!out.openedOk()) {
+				return false;
+			}
+			write(out);
+			out.flush();
+			// A failed write is remembered in the status, so checking once at the end covers all of them
+			if (out.getStatus().failed()) {
+				return false;
+			}
+		}
+		return temporary.overwriteTargetFileWithTemporary();
+	}
+
+}
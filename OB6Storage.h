@@ -0,0 +1,20 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <functional>
+
+namespace midikraft {
+
+	// Writes the file via a temporary file that replaces the target only after everything was written successfully.
+	// Never write into the existing file: FileOutputStream appends to it, deleting it fails while another process has it open,
+	// and truncating a file that is memory mapped elsewhere pulls the data away under the reader
+	bool ob6WriteFileReplacing(File const &file, std::function<void(OutputStream &out)> write);
+
+}
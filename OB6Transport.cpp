@@ -0,0 +1,86 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6Transport.h"
+
+#include <algorithm>
+
+namespace midikraft {
+
+	int OB6Transport::byteCount(std::vector<MidiMessage> const &messages)
+	{
+		int bytes = 0;
+		for (auto const &message : messages) {
+			bytes += message.getRawDataSize();
+		}
+		return bytes;
+	}
+
+	double OB6Transport::dinMilliseconds(int bytes)
+	{
+		// One start and one stop bit per byte
+		return bytes * 10 * 1000.0 / 31250.0;
+	}
+
+	void OB6Transport::addIncomingHandler(MidiController::HandlerHandle const &handle, IncomingHandler handler)
+	{
+		std::lock_guard<std::recursive_mutex> lock(handlersMutex_);
+		handlers_.emplace_back(handle, handler);
+	}
+
+	bool OB6Transport::removeIncomingHandler(MidiController::HandlerHandle const &handle)
+	{
+		std::lock_guard<std::recursive_mutex> lock(handlersMutex_);
+		auto found = std::find_if(handlers_.begin(), handlers_.end(), [&handle](std::pair<MidiController::HandlerHandle, IncomingHandler> const &entry) { return entry.first == handle; });
+		if (found == handlers_.end()) {
+			return false;
+		}
+		handlers_.erase(found);
+		return true;
+	}
+
+	void OB6Transport::dispatch(MidiMessage const &message)
+	{
+		// Holding the lock while calling serializes the handlers, so e.g. the OB6DecodeQueue of a requester keeps its single producer
+		std::lock_guard<std::recursive_mutex> lock(handlersMutex_);
+		for (auto const &handler : handlers_) {
+			handler.second(message);
+		}
+	}
+
+	MidiControllerTransport::MidiControllerTransport(MidiController *controller, std::string const &input, std::string const &output) :
+		controller_(controller), input_(input), output_(output), handle_(MidiController::makeOneHandle())
+	{
+		controller_->enableMidiInput(input_);
+		controller_->addMessageHandler(handle_, [this](MidiInput *source, MidiMessage const &message) {
+			// The MidiController calls us for all inputs, only take those from our own
+			if (source && source->getName().toStdString() == input_) {
+				dispatch(message);
+			}
+		});
+	}
+
+	MidiControllerTransport::~MidiControllerTransport()
+	{
+		controller_->removeMessageHandler(handle_);
+	}
+
+	std::string MidiControllerTransport::inputName() const
+	{
+		return input_;
+	}
+
+	std::string MidiControllerTransport::outputName() const
+	{
+		return output_;
+	}
+
+	void MidiControllerTransport::send(std::vector<MidiMessage> const &messages)
+	{
+		controller_->getMidiOutput(output_)->sendBlockOfMessagesFullSpeed(messages);
+	}
+
+}
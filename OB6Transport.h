@@ -0,0 +1,64 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "MidiController.h"
+
+#include <mutex>
+
+namespace midikraft {
+
+	// The connection to one OB-6, so higher level operations can run against real MIDI ports as well as against the OB6Simulator
+	class OB6Transport {
+	public:
+		typedef std::function<void(MidiMessage const &message)> IncomingHandler;
+
+		virtual ~OB6Transport() = default;
+
+		virtual std::string inputName() const = 0;
+		virtual std::string outputName() const = 0;
+
+		virtual void send(std::vector<MidiMessage> const &messages) = 0;
+
+		// Any number of handlers can listen, e.g. an OB6Unit and an OB6Requester on the same transport. The handlers are called on the MIDI thread, keep them short.
+		// They are never called concurrently, even if replies are produced on several threads, and once removeIncomingHandler() returns the handler is not called again.
+		// A handler may send, but must not add or remove handlers
+		void addIncomingHandler(MidiController::HandlerHandle const &handle, IncomingHandler handler);
+		bool removeIncomingHandler(MidiController::HandlerHandle const &handle);
+
+		// Size of the messages on the wire, and how long they take over 5-pin DIN at 31250 baud
+		static int byteCount(std::vector<MidiMessage> const &messages);
+		static double dinMilliseconds(int bytes);
+
+	protected:
+		void dispatch(MidiMessage const &message);
+
+	private:
+		std::recursive_mutex handlersMutex_; // Recursive, because a handler sending to the OB6Simulator receives the replies on the same thread
+		std::vector<std::pair<MidiController::HandlerHandle, IncomingHandler>> handlers_;
+	};
+
+	class MidiControllerTransport : public OB6Transport {
+	public:
+		MidiControllerTransport(MidiController *controller, std::string const &input, std::string const &output);
+		virtual ~MidiControllerTransport() override;
+
+		virtual std::string inputName() const override;
+		virtual std::string outputName() const override;
+
+		virtual void send(std::vector<MidiMessage> const &messages) override;
+
+	private:
+		MidiController *controller_;
+		std::string input_;
+		std::string output_;
+		MidiController::HandlerHandle handle_;
+	};
+
+}
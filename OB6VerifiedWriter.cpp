@@ -0,0 +1,88 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OB6VerifiedWriter.h"
+
+#include "Patch.h"
+
+#include <chrono>
+#include <deque>
+#include <thread>
+
+namespace midikraft {
+
+	OB6VerifiedWriter::OB6VerifiedWriter(std::shared_ptr<OB6> synth, std::shared_ptr<OB6Transport> transport, OB6Requester &requester) :
+		synth_(synth), transport_(transport), requester_(requester)
+	{
+	}
+
+	OB6VerifiedWriter::Report OB6VerifiedWriter::write(std::vector<std::shared_ptr<DataFile>> const &programs, int gapMilliseconds, int maxRetries, OB6DeviceContents *contents)
+	{
+		Report report = { 0, 0, 0, {}, 0.0 };
+		double start = Time::getMillisecondCounterHiRes();
+
+		std::vector<std::shared_ptr<Patch>> toWrite;
+		for (auto const &program : programs) {
+			auto patch = std::dynamic_pointer_cast<Patch>(program);
+			if (patch) {
+				toWrite.push_back(patch);
+			}
+		}
+
+		for (int attempt = 0; attempt <= maxRetries && !toWrite.empty(); attempt++) {
+			if (attempt > 0) {
+				report.retries += (int)toWrite.size();
+			}
+			std::vector<std::shared_ptr<Patch>> failed;
+			std::deque<InFlight> inFlight;
+			auto collect = [&](bool wait) {
+				// Check the read-backs in order, without waiting unless asked to
+				while (!inFlight.empty() && (wait || inFlight.front().readBack.wait_for(std::chrono::seconds(0)) == std::future_status::ready)) {
+					if (verify(inFlight.front(), contents)) {
+						report.verified++;
+					}
+					else {
+						failed.push_back(inFlight.front().patch);
+					}
+					inFlight.pop_front();
+				}
+			};
+
+			for (auto const &patch : toWrite) {
+				transport_->send(synth_->patchToProgramDumpSysex(patch, patch->patchNumber()));
+				report.written++;
+				// The OB-6 handles messages in order, so the reply will contain what we just wrote
+				inFlight.push_back({ patch, requester_.fetchProgram(patch->patchNumber()) });
+				std::this_thread::sleep_for(std::chrono::milliseconds(gapMilliseconds));
+				collect(false);
+			}
+			collect(true);
+			toWrite = failed;
+		}
+
+		for (auto const &patch : toWrite) {
+			report.failedSlots.push_back(patch->patchNumber().toZeroBased());
+			if (contents) {
+				contents->forget(patch->patchNumber().toZeroBased());
+			}
+		}
+		report.milliseconds = Time::getMillisecondCounterHiRes() - start;
+		return report;
+	}
+
+	bool OB6VerifiedWriter::verify(InFlight &inFlight, OB6DeviceContents *contents)
+	{
+		auto readBack = inFlight.readBack.get();
+		if (readBack && synth_->voiceFingerprint(readBack) == synth_->voiceFingerprint(inFlight.patch)) {
+			if (contents) {
+				contents->remember(inFlight.patch->patchNumber().toZeroBased(), readBack);
+			}
+			return true;
+		}
+		return false;
+	}
+
+}
@@ -0,0 +1,45 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "OB6Requester.h"
+#include "OB6DeltaSync.h"
+
+namespace midikraft {
+
+	// Writes programs to the OB-6 and reads every slot back to confirm it was stored. The read-back request for a slot goes out right
+	// after its program dump, so verification runs while the later writes are still being sent and adds little to the total time.
+	// Slots are compared by voice fingerprint, and slots that failed are written again
+	class OB6VerifiedWriter {
+	public:
+		struct Report {
+			int written;
+			int verified;
+			int retries;
+			std::vector<int> failedSlots;
+			double milliseconds;
+		};
+
+		OB6VerifiedWriter(std::shared_ptr<OB6> synth, std::shared_ptr<OB6Transport> transport, OB6Requester &requester);
+
+		// The programs are written to the slots given by their patch number. If contents are given, verified slots are remembered there
+		Report write(std::vector<std::shared_ptr<DataFile>> const &programs, int gapMilliseconds = 20, int maxRetries = 2, OB6DeviceContents *contents = nullptr);
+
+	private:
+		struct InFlight {
+			std::shared_ptr<Patch> patch;
+			std::future<std::shared_ptr<DataFile>> readBack;
+		};
+
+		bool verify(InFlight &inFlight, OB6DeviceContents *contents);
+
+		std::shared_ptr<OB6> synth_;
+		std::shared_ptr<OB6Transport> transport_;
+		OB6Requester &requester_;
+	};
+
+}
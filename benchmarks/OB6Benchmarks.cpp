@@ -0,0 +1,148 @@
+/*
+   Copyright (c) 2020 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+// Timings for the library-scale OB-6 code paths on synthetic patches. Build with -DMIDIKRAFT_OB6_BENCHMARKS=ON,
+// run without arguments for all benchmarks or pass the name of one
+
+#include "OB6.h"
+#include "OB6Patch.h"
+#include "OB6ParameterMatrix.h"
+#include "OB6ParameterQuery.h"
+#include "OB6PatchClustering.h"
+#include "OB6Pacing.h"
+#include "OB6Simulator.h"
+
+#include <boost/format.hpp>
+
+#include <functional>
+#include <iostream>
+#include <random>
+#include <thread>
+
+using namespace midikraft;
+
+namespace {
+
+	// Random programs with every parameter in its range, and a name so the patches look like real ones
+	std::vector<std::shared_ptr<DataFile>> syntheticLibrary(size_t count, uint64 seed) {
+		std::mt19937_64 random(seed);
+		std::vector<std::shared_ptr<DataFile>> result;
+		result.reserve(count);
+		for (size_t i = 0; i < count; i++) {
+			auto patch = std::make_shared<OB6Patch>(OB6::PATCH, Synth::PatchData(kOB6ProgramSize, 0), MidiProgramNumber::fromZeroBase((int)(i % 1000)));
+			for (auto const &definition : kOB6ParameterLayout) {
+				patch->setParameter(definition.parameter, definition.minValue + (int)(random() % (uint64)(definition.range() + 1)));
+			}
+			patch->setName((boost::format("Synthetic %d") % i).str());
+			result.push_back(patch);
+		}
+		return result;
+	}
+
+	// Runs the job repeatedly for at least 200 ms and returns the average milliseconds per run
+	double timeIt(std::function<void()> job) {
+		int runs = 0;
+		double start = Time::getMillisecondCounterHiRes();
+		double elapsed = 0.0;
+		do {
+			job();
+			runs++;
+			elapsed = Time::getMillisecondCounterHiRes() - start;
+		} while (elapsed < 200.0);
+		return elapsed / runs;
+	}
+
+	void benchmarkQuery() {
+		const char *queries[] = {
+			"cutoff < 40",
+			"cutoff < 40 AND resonance > 100 AND arp on",
+			"amp env attack > 60 AND amp env release > 80 OR NOT unison on",
+		};
+		for (size_t size : { 10000, 100000, 1000000 }) {
+			auto library = syntheticLibrary(size, 1);
+			double start = Time::getMillisecondCounterHiRes();
+			auto matrix = OB6ParameterMatrix::build(library);
+			double buildMilliseconds = Time::getMillisecondCounterHiRes() - start;
+			std::cout << (boost::format("query %7d patches: matrix build %8.2f ms\n") % size % buildMilliseconds).str();
+			for (auto expression : queries) {
+				OB6ParameterQuery query(expression);
+				size_t hits = 0;
+				double milliseconds = timeIt([&]() { hits = OB6ParameterMatrix::count(query.evaluate(matrix)); });
+				std::cout << (boost::format("query %7d patches: %8.3f ms %8d hits  %s\n") % size % milliseconds % hits % expression).str();
+			}
+		}
+	}
+
+	// Same seed and iteration count for every thread count, so the runs do identical work and only the scaling shows
+	void benchmarkClustering() {
+		auto library = syntheticLibrary(100000, 2);
+		auto matrix = OB6ParameterMatrix::build(library);
+		std::vector<int> threadCounts = { 1, 2, 4 };
+		int cores = (int)std::max(1u, std::thread::hardware_concurrency());
+		if (cores > 4) threadCounts.push_back(cores);
+		double singleThreaded = 0.0;
+		for (int threads : threadCounts) {
+			OB6PatchClustering::Options options;
+			options.clusters = 16;
+			options.maxIterations = 20;
+			options.seed = 3;
+			options.threads = threads;
+			OB6PatchClustering::Result result;
+			double start = Time::getMillisecondCounterHiRes();
+			result = OB6PatchClustering::cluster(matrix, options);
+			double milliseconds = Time::getMillisecondCounterHiRes() - start;
+			if (singleThreaded == 0.0) singleThreaded = milliseconds;
+			std::cout << (boost::format("clustering 100000 patches, %2d threads: %8.1f ms, speedup %4.2f, %d iterations, inertia %.1f\n")
+				% threads % milliseconds % (singleThreaded / milliseconds) % result.iterations % result.inertia).str();
+		}
+	}
+
+	// The pacing controller against the simulated OB-6, which loses every dump arriving less than 8 ms after the previous one and drops others at random.
+	// For drop rates below the controller's 10 % tolerance, the gap should end up close to 8 ms instead of drifting up to the safe gap
+	void benchmarkPacing() {
+		for (double dropRate : { 0.0, 0.02, 0.05 }) {
+			auto simulator = std::make_shared<OB6Simulator>("Simulated OB-6", MidiChannel::fromOneBase(1));
+			simulator->setMinimumGapMilliseconds(8.0);
+			simulator->setDropRate(dropRate, 1);
+			auto synth = std::make_shared<OB6>();
+			synth->setCurrentChannelZeroBased(simulator->inputName(), simulator->outputName(), 0);
+			OB6Requester requester(synth, simulator);
+			OB6VerifiedWriter writer(synth, simulator, requester);
+			OB6PacingController pacing((boost::format("Simulated OB-6 %.2f") % dropRate).str(), 50);
+			auto programs = syntheticLibrary(20, 5);
+			int calibrated = pacing.calibrate(writer, programs);
+			int resent = 0;
+			int failed = 0;
+			for (int batch = 0; batch < 30; batch++) {
+				auto report = writer.write(programs, pacing.gapMilliseconds(), 2);
+				// Every program that had to be sent again counts as a loss
+				if (report.retries > 0) {
+					pacing.reportLoss(report.retries);
+				}
+				pacing.reportSuccess(std::max(0, (int)programs.size() - report.retries));
+				resent += report.retries;
+				failed += (int)report.failedSlots.size();
+			}
+			std::cout << (boost::format("pacing drop rate %.2f: calibrated %2d ms, after 600 programs %2d ms, %d resent, %d failed, %d dumps dropped\n")
+				% dropRate % calibrated % pacing.gapMilliseconds() % resent % failed % simulator->droppedDumps()).str();
+		}
+	}
+
+}
+
+int main(int argc, char *argv[]) {
+	std::vector<std::pair<std::string, std::function<void()>>> benchmarks = {
+		{ "query", benchmarkQuery },
+		{ "clustering", benchmarkClustering },
+		{ "pacing", benchmarkPacing },
+	};
+	for (auto const &benchmark : benchmarks) {
+		if (argc < 2 || benchmark.first == argv[1]) {
+			benchmark.second();
+		}
+	}
+	return 0;
+}